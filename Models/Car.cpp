@@ -10,16 +10,18 @@ Car::Car(std::string make, std::string model, int year)
 
 // Getters
 int Car::getCarId() const { return carId; }
-std::string Car::getMake() const { return make; }
-std::string Car::getModel() const { return model; }
+const std::string& Car::getMake() const { return make; }
+const std::string& Car::getModel() const { return model; }
 int Car::getYear() const { return year; }
 double Car::getPrice() const { return price; }
 int Car::getMileage() const { return mileage; }
-std::string Car::getColor() const { return color; }
-std::string Car::getVin() const { return vin; }
-std::string Car::getImageDataUrl() const { return imageDataUrl; } // ✅ NEW
-std::string Car::getCreatedAt() const { return createdAt; }
-std::string Car::getUpdatedAt() const { return updatedAt; }
+const std::string& Car::getColor() const { return color; }
+const std::string& Car::getVin() const { return vin; }
+const std::string& Car::getImageDataUrl() const { return imageDataUrl; } // ✅ NEW
+bool Car::hasImage() const { return !imageHash.empty(); }
+const std::string& Car::getImageHash() const { return imageHash; }
+const std::string& Car::getCreatedAt() const { return createdAt; }
+const std::string& Car::getUpdatedAt() const { return updatedAt; }
 
 // Setters
 void Car::setCarId(int carId) { this->carId = carId; }
@@ -31,5 +33,8 @@ void Car::setMileage(int mileage) { this->mileage = mileage; }
 void Car::setColor(const std::string& color) { this->color = color; }
 void Car::setVin(const std::string& vin) { this->vin = vin; }
 void Car::setImageDataUrl(const std::string& imageDataUrl) { this->imageDataUrl = imageDataUrl; } // ✅ NEW
+std::string Car::takeImageDataUrl() { std::string taken = std::move(imageDataUrl); imageDataUrl.clear(); return taken; }
+void Car::setImageDataUrl(std::string&& imageDataUrl) { this->imageDataUrl = std::move(imageDataUrl); }
+void Car::setImageHash(const std::string& imageHash) { this->imageHash = imageHash; }
 void Car::setCreatedAt(const std::string& createdAt) { this->createdAt = createdAt; }
 void Car::setUpdatedAt(const std::string& updatedAt) { this->updatedAt = updatedAt; }
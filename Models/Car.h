@@ -8,16 +8,18 @@ public:
 
     // Getters
     int getCarId() const;
-    std::string getMake() const;
-    std::string getModel() const;
+    const std::string& getMake() const;
+    const std::string& getModel() const;
     int getYear() const;
     double getPrice() const;
     int getMileage() const;
-    std::string getColor() const;
-    std::string getVin() const;
-    std::string getImageDataUrl() const;   
-    std::string getCreatedAt() const;
-    std::string getUpdatedAt() const;
+    const std::string& getColor() const;
+    const std::string& getVin() const;
+    const std::string& getImageDataUrl() const;   
+    bool hasImage() const;
+    const std::string& getImageHash() const;
+    const std::string& getCreatedAt() const;
+    const std::string& getUpdatedAt() const;
 
     // Setters
     void setCarId(int carId);
@@ -29,6 +31,9 @@ public:
     void setColor(const std::string& color);
     void setVin(const std::string& vin);
     void setImageDataUrl(const std::string& imageDataUrl); 
+    std::string takeImageDataUrl();   // moves the data URL out, leaving it empty
+    void setImageDataUrl(std::string&& imageDataUrl);   // data URLs can be megabytes; take ownership
+    void setImageHash(const std::string& imageHash);
     void setCreatedAt(const std::string& createdAt);
     void setUpdatedAt(const std::string& updatedAt);
 
@@ -41,7 +46,8 @@ private:
     int mileage;
     std::string color;
     std::string vin;
-    std::string imageDataUrl;     
+    std::string imageDataUrl;     // only populated on writes; reads carry imageHash instead
+    std::string imageHash;
     std::string createdAt;
     std::string updatedAt;
 };
@@ -0,0 +1,102 @@
+// Serializes a listing's worth of cars with CarJson::write and with the
+// crow::json::wvalue path it replaced, and prints the time per car for each.
+// Usage: car_json_bench [cars] [rounds]
+#include "crow.h"
+#include "Car.h"
+#include "CarJson.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The per-car serializer CarRoutes used before CarJson
+static crow::json::wvalue toJson(const Car& car, uint32_t fields) {
+    crow::json::wvalue json;
+    if (fields & CarFields::Id) json["id"] = car.getCarId();
+    if (fields & CarFields::Make) json["make"] = car.getMake();
+    if (fields & CarFields::Model) json["model"] = car.getModel();
+    if (fields & CarFields::Year) json["year"] = car.getYear();
+    if (fields & CarFields::Price) json["price"] = car.getPrice();
+    if (fields & CarFields::Mileage) json["mileageKm"] = car.getMileage();
+    if (fields & CarFields::Color) json["color"] = car.getColor();
+    if (fields & CarFields::Vin) json["vin"] = car.getVin();
+    if (fields & CarFields::Image) {
+        if (car.hasImage()) json["imageUrl"] = "/api/cars/" + std::to_string(car.getCarId()) + "/image?v=" + car.getImageHash();
+        else json["imageUrl"] = nullptr;
+    }
+    if (fields & CarFields::CreatedAt) json["createdAt"] = car.getCreatedAt();
+    if (fields & CarFields::UpdatedAt) json["updatedAt"] = car.getUpdatedAt();
+    return json;
+}
+
+static std::vector<Car> makeCars(size_t count) {
+    static const char* makes[] = {"Toyota", "Ford", "Honda", "Volkswagen", "Kia"};
+    std::vector<Car> cars;
+    cars.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        Car car(makes[i % 5], "Model " + std::to_string(i % 37), 2000 + static_cast<int>(i % 25));
+        car.setCarId(static_cast<int>(i + 1));
+        car.setPrice(5000 + (i % 400) * 97.5);
+        car.setMileage(static_cast<int>(i * 131 % 300000));
+        car.setColor(i % 3 ? "Silver" : "");
+        car.setVin("VIN" + std::to_string(100000 + i));
+        if (i % 4 == 0) car.setImageHash("4a5eb7171b58e08a6881721e3b43d5a44419a2be");
+        car.setCreatedAt("2026-01-01 12:00:00");
+        car.setUpdatedAt("2026-01-02 08:30:00");
+        cars.push_back(std::move(car));
+    }
+    return cars;
+}
+
+// Best of rounds, in nanoseconds per car; out keeps the work observable
+template <typename Serialize>
+static double measure(const std::vector<Car>& cars, int rounds, Serialize serialize, size_t& bytes) {
+    double best = 0;
+    for (int round = 0; round < rounds; round++) {
+        std::string out = "[";
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < cars.size(); i++) {
+            if (i) out += ',';
+            serialize(cars[i], out);
+        }
+        out += ']';
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        bytes = out.size();
+        double perCar = elapsed / cars.size();
+        if (round == 0 || perCar < best) best = perCar;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+    if (count == 0 || rounds <= 0) {
+        std::cerr << "usage: car_json_bench [cars] [rounds]" << std::endl;
+        return 1;
+    }
+
+    std::vector<Car> cars = makeCars(count);
+    const uint32_t projections[] = {CarFields::All, CarFields::Id | CarFields::Make | CarFields::Price};
+    const char* names[] = {"all fields", "id,make,price"};
+
+    for (int p = 0; p < 2; p++) {
+        uint32_t fields = projections[p];
+        size_t carJsonBytes = 0, wvalueBytes = 0;
+
+        double carJson = measure(cars, rounds, [fields](const Car& car, std::string& out) {
+            CarJson::write(car, fields, out);
+        }, carJsonBytes);
+        double wvalue = measure(cars, rounds, [fields](const Car& car, std::string& out) {
+            out += toJson(car, fields).dump();
+        }, wvalueBytes);
+
+        std::cout << names[p] << " (" << count << " cars, best of " << rounds << "):\n"
+                  << "  CarJson::write  " << carJson << " ns/car, " << carJsonBytes << " bytes\n"
+                  << "  wvalue::dump    " << wvalue << " ns/car, " << wvalueBytes << " bytes\n"
+                  << "  speedup         " << wvalue / carJson << "x" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "crow.h"
+#include "AdmissionMiddleware.h"
+#include "CompressionMiddleware.h"
+
+// The server's Crow application, with the middleware every route runs through.
+// Admission comes first, so shed requests cost no further work.
+using CarApp = crow::App<AdmissionMiddleware, CompressionMiddleware>;
@@ -1,186 +1,628 @@
 #pragma once
 #include "crow.h"
+#include "CarApp.h"
 #include "database.h"
 #include "Car.h"
 #include <vector>
 #include <string>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
 #include "StringUtils.h"
+#include "CarJson.h"
+#include "CarPayload.h"
+#include "CarCsv.h"
 class CarRoutes {
 public:
-    static void setupRoutes(crow::SimpleApp& app, Database& db) {
+    static constexpr int DefaultPageSize = 50;
+    static constexpr int MaxPageSize = 500;
+    static constexpr size_t MaxBatchRows = 10000;
+    static constexpr size_t MaxLookupIds = 1000;
 
-        auto getString = [](const crow::json::rvalue& body, const std::string& key) -> std::string {
-            if (!body.has(key)) return "";
-            if (body[key].t() == crow::json::type::String) return body[key].s();
-            return "";
-        };
+    // Exports are spooled here until sent; leftovers older than ExportRetention are swept
+    static constexpr const char* ExportDir = "data/exports";
+    static constexpr std::chrono::minutes ExportRetention{10};
+    static constexpr size_t ExportChunk = 64 * 1024;
+    // Each export holds a reader and a spool file until it is written out
+    static constexpr int MaxConcurrentExports = 2;
 
-        auto getInt = [](const crow::json::rvalue& body, const std::string& key, int def = 0) -> int {
-            if (!body.has(key)) return def;
-            if (body[key].t() == crow::json::type::Number) return body[key].i();
-            return def;
-        };
+    // Members POST and PUT bodies must carry
+    static constexpr uint32_t RequiredFields =
+        CarFields::Make | CarFields::Model | CarFields::Year | CarFields::Price | CarFields::Mileage;
 
-        auto getDouble = [](const crow::json::rvalue& body, const std::string& key, double def = 0.0) -> double {
-            if (!body.has(key)) return def;
-            if (body[key].t() == crow::json::type::Number) return body[key].d();
-            return def;
-        };
+    // Columns a PUT overwrites; optional ones it omits are cleared
+    static constexpr uint32_t ReplacedFields = RequiredFields | CarFields::Color | CarFields::Vin;
 
-        // GET all
+    static void setupRoutes(CarApp& app, Database& db) {
+
+        // GET all, or one keyset page when ?limit= or ?cursor= is given.
+        // ?fields=id,make,... limits both the columns read and the JSON members;
+        // make, model, color, min/maxPrice, min/maxYear, maxMileage and sort
+        // filter and order the listing in SQL.
+        // ?since=<version> returns only what changed after that version (the
+        // number in a previous ETag or delta), filters and paging aside.
+        // ?ids=1,5,9 fetches those cars in that order, listing missing ids.
         CROW_ROUTE(app, "/api/cars").methods("GET"_method)
+        (offload(db, [&db](const crow::request& req) {
+            uint32_t fields = CarFields::All;
+            std::string unknown;
+            if (!CarFields::parse(req.url_params.get("fields"), fields, unknown)) {
+                crow::json::wvalue error;
+                error["error"] = "Unknown field: " + unknown;
+                return crow::response(400, error);
+            }
+
+            CarQuery query;
+            std::string invalid;
+            if (!parseQuery(req, query, invalid)) {
+                crow::json::wvalue error;
+                error["error"] = invalid;
+                return crow::response(400, error);
+            }
+
+            const char* limitParam = req.url_params.get("limit");
+            const char* cursorParam = req.url_params.get("cursor");
+
+            // Nothing was written since the client's copy: answer before any read
+            uint64_t version = db.dataVersion();
+            std::string etag = versionTag(version);
+            if (etagMatches(req.get_header_value("If-None-Match"), etag)) return notModified(etag);
+
+            if (const char* sinceParam = req.url_params.get("since")) {
+                uint64_t since = 0;
+                if (!parseVersion(sinceParam, since)) {
+                    crow::json::wvalue error;
+                    error["error"] = "since must be a version number";
+                    return crow::response(400, error);
+                }
+                return changesSince(db, since, version, fields);
+            }
+
+            if (const char* idsParam = req.url_params.get("ids")) {
+                std::vector<int> ids;
+                if (!parseIds(idsParam, ids)) {
+                    crow::json::wvalue error;
+                    error["error"] = "ids must be a comma-separated list of up to " + std::to_string(MaxLookupIds) + " car ids";
+                    return crow::response(400, error);
+                }
+                crow::response res = multiGet(db, ids, fields);
+                if (res.code == 200) {
+                    res.set_header("ETag", "\"" + etag + "\"");
+                    res.set_header("Cache-Control", "no-cache");
+                }
+                return res;
+            }
+
+            // Rows are serialized straight off the cursor into the body; full
+            // rows come from the JSON cache instead, the scan then reading ids
+            // only and misses being fetched and serialized in chunks. The body
+            // is still built whole before it is sent, so an unpaged listing
+            // grows with the table; clients that need bounded responses page
+            // with ?limit=.
+            crow::response res(200);
+            res.set_header("Content-Type", "application/json");
+            res.set_header("ETag", "\"" + etag + "\"");
+            res.set_header("Cache-Control", "no-cache");
+
+            bool cached = fields == CarFields::All;
+            std::vector<int> ids;
+            bool first = true;
+            auto emit = [&](const Car& car) {
+                if (cached) {
+                    ids.push_back(car.getCarId());
+                    return;
+                }
+                if (!first) res.body += ',';
+                first = false;
+                CarJson::write(car, fields, res.body);
+            };
+            uint32_t scanFields = cached ? CarFields::Id : fields;
+
+            if (!limitParam && !cursorParam) {
+                res.body = "[";
+                if (!db.forEachCar(query, 0, scanFields, emit) || !appendCached(db, ids, res.body, first)) {
+                    crow::json::wvalue error;
+                    error["error"] = "Failed to load cars";
+                    return crow::response(500, error);
+                }
+                res.body += ']';
+                return res;
+            }
+
+            int limit = DefaultPageSize;
+            if (limitParam && !parsePositiveInt(limitParam, limit)) {
+                crow::json::wvalue error;
+                error["error"] = "limit must be a positive integer";
+                return crow::response(400, error);
+            }
+            if (limit > MaxPageSize) limit = MaxPageSize;
+
+            if (cursorParam && !decodeCursor(cursorParam, query)) {
+                crow::json::wvalue error;
+                error["error"] = "Invalid cursor";
+                return crow::response(400, error);
+            }
+
+            // Fetch one extra row to learn whether another page exists
+            int count = 0;
+            std::string cursor;
+            res.body = "{\"items\":[";
+            bool ok = db.forEachCar(query, limit + 1, scanFields, [&](const Car& car) {
+                if (++count > limit) return;
+                emit(car);
+                if (count == limit) cursor = encodeCursor(query.sort, car);
+            });
+            if (!ok || !appendCached(db, ids, res.body, first)) {
+                crow::json::wvalue error;
+                error["error"] = "Failed to load cars";
+                return crow::response(500, error);
+            }
+
+            res.body += "],\"next\":";
+            if (count > limit) {
+                std::string next = nextPageUrl(req, limit, cursor);
+                res.body += '"';
+                crow::json::escape(next, res.body);
+                res.body += '"';
+                res.add_header("Link", "<" + next + ">; rel=\"next\"");
+            } else {
+                res.body += "null";
+            }
+            res.body += '}';
+            return res;
+        }));
+
+        // GET distinct make/model/color/year values with counts, for filter dropdowns.
+        // Served from the in-memory facet index; no table access.
+        CROW_ROUTE(app, "/api/cars/facets").methods("GET"_method)
         ([&db]() {
-            std::vector<Car> cars = db.getAllCars();
-            crow::json::wvalue response = crow::json::wvalue::list();
-
-            for (size_t i = 0; i < cars.size(); i++) {
-                response[i]["id"] = cars[i].getCarId();
-                response[i]["make"] = cars[i].getMake();
-                response[i]["model"] = cars[i].getModel();
-                response[i]["year"] = cars[i].getYear();
-                response[i]["price"] = cars[i].getPrice();
-                response[i]["mileageKm"] = cars[i].getMileage();
-                response[i]["color"] = cars[i].getColor();
-                response[i]["vin"] = cars[i].getVin();
-                response[i]["imageDataUrl"] = cars[i].getImageDataUrl(); 
-                response[i]["createdAt"] = cars[i].getCreatedAt();
-                response[i]["updatedAt"] = cars[i].getUpdatedAt();
+            Facets facets = db.facets();
+            crow::json::wvalue response;
+
+            std::vector<crow::json::wvalue> makes;
+            for (const auto& entry : facets.makes) {
+                if (entry.second <= 0) continue;
+                crow::json::wvalue item;
+                item["value"] = entry.first;
+                item["count"] = entry.second;
+                makes.push_back(std::move(item));
+            }
+            response["make"] = std::move(makes);
+
+            std::vector<crow::json::wvalue> models;
+            for (const auto& entry : facets.models) {
+                if (entry.second <= 0) continue;
+                crow::json::wvalue item;
+                item["make"] = entry.first.first;
+                item["value"] = entry.first.second;
+                item["count"] = entry.second;
+                models.push_back(std::move(item));
+            }
+            response["model"] = std::move(models);
+
+            std::vector<crow::json::wvalue> colors;
+            for (const auto& entry : facets.colors) {
+                if (entry.second <= 0) continue;
+                crow::json::wvalue item;
+                item["value"] = entry.first;
+                item["count"] = entry.second;
+                colors.push_back(std::move(item));
+            }
+            response["color"] = std::move(colors);
+
+            std::vector<crow::json::wvalue> years;
+            for (const auto& entry : facets.years) {
+                if (entry.second <= 0) continue;
+                crow::json::wvalue item;
+                item["value"] = entry.first;
+                item["count"] = entry.second;
+                years.push_back(std::move(item));
             }
+            response["year"] = std::move(years);
+
             return crow::response(200, response);
         });
 
+        // Change stream over WebSocket. Opens with
+        // {"type":"hello","version":V,"window":N}, then sends one event per
+        // committed write: {"type":"created|updated|deleted","version":S,"id":I[,"car":{...}]}.
+        // Events with version <= V are already reflected in V and can be
+        // skipped (but still acknowledged). Clients reply {"ack":S} as they
+        // process events; one with more than
+        // window events unacknowledged is closed with code 4000 and should
+        // catch up through GET /api/cars?since= before reconnecting.
+        db.addChangeListener([&db](const CarChange& change) {
+            db.changeFeed().publish(change.seq, changeEvent(change));
+        });
+
+        CROW_WEBSOCKET_ROUTE(app, "/api/cars/stream")
+        .onopen([&db](crow::websocket::connection& conn) {
+            ChangeFeed& feed = db.changeFeed();
+            uint64_t id = feed.subscribe(
+                [&conn](const std::string& message) { conn.send_text(message); },
+                [&conn]() { conn.close("Too far behind; resync with ?since=", 4000); },
+                [&db, &feed]() {
+                    return "{\"type\":\"hello\",\"version\":" + std::to_string(db.dataVersion()) +
+                           ",\"window\":" + std::to_string(feed.window()) + "}";
+                });
+            conn.userdata(reinterpret_cast<void*>(static_cast<uintptr_t>(id)));
+        })
+        .onmessage([&db](crow::websocket::connection& conn, const std::string& data, bool isBinary) {
+            auto message = crow::json::load(data);
+            if (isBinary || !message || message.t() != crow::json::type::Object || !message.has("ack")) return;
+            if (message["ack"].t() != crow::json::type::Number) return;
+
+            db.changeFeed().acknowledge(subscriberId(conn), static_cast<uint64_t>(message["ack"].u()));
+        })
+        .onclose([&db](crow::websocket::connection& conn, const std::string&, uint16_t) {
+            db.changeFeed().unsubscribe(subscriberId(conn));
+        });
+
+        // Each spool file is removed once sent; the sweep only catches ones
+        // left behind by a crash, now and then every ExportRetention
+        sweepExports();
+        app.tick(ExportRetention, [&db]() { db.executor().submit(sweepExports); });
+
+        // GET the whole inventory as NDJSON (default) or CSV: ?format=ndjson|csv.
+        // ?fields= works as for listings and ?images=false leaves out imageUrl.
+        // This spools, it does not stream: the whole export is written from one
+        // SQLite snapshot to a file under ExportDir before the first byte is
+        // sent, then Crow sends that file and it is deleted. Memory stays flat,
+        // but the response starts only once the file is complete, and each
+        // running export holds a copy of the table on disk until it is sent.
+        // At most MaxConcurrentExports run at once; more get a 503 with
+        // Retry-After.
+        CROW_ROUTE(app, "/api/cars/export").methods("GET"_method)
+        (offloadFile(db, [&db](const crow::request& req, std::string& file) {
+            uint32_t fields = CarFields::All;
+            std::string unknown;
+            if (!CarFields::parse(req.url_params.get("fields"), fields, unknown)) {
+                crow::json::wvalue error;
+                error["error"] = "Unknown field: " + unknown;
+                return crow::response(400, error);
+            }
+
+            const char* format = req.url_params.get("format");
+            std::string type = format ? format : "ndjson";
+            if (type != "ndjson" && type != "csv") {
+                crow::json::wvalue error;
+                error["error"] = "format must be ndjson or csv";
+                return crow::response(400, error);
+            }
+            bool csv = type == "csv";
+
+            const char* images = req.url_params.get("images");
+            if (images && (std::string(images) == "false" || std::string(images) == "0")) fields &= ~CarFields::Image;
+
+            static std::atomic<int> running{0};
+            if (running.fetch_add(1) >= MaxConcurrentExports) {
+                running.fetch_sub(1);
+                crow::json::wvalue error;
+                error["error"] = "Too many exports running, try again shortly";
+                crow::response res(503, error);
+                res.set_header("Retry-After", "5");
+                return res;
+            }
+            std::string path;
+            bool spooled = spoolExport(db, csv, fields, path);
+            running.fetch_sub(1);
+
+            if (!spooled) {
+                crow::json::wvalue error;
+                error["error"] = "Failed to export cars";
+                return crow::response(500, error);
+            }
+
+            file = path;
+            crow::response res;
+            res.set_static_file_info_unsafe(path, csv ? "text/csv" : "application/x-ndjson");
+            res.set_header("Content-Disposition", "attachment; filename=\"cars." + type + "\"");
+            res.set_header("Cache-Control", "no-store");
+            return res;
+        }));
+
         // GET by id
         CROW_ROUTE(app, "/api/cars/<int>").methods("GET"_method)
-        ([&db](int id) {
-            bool found = false;
-            Car car = db.getCarById(id, found);
+        (offload<int>(db, [&db](const crow::request& req, int id) {
+            uint32_t fields = CarFields::All;
+            std::string unknown;
+            if (!CarFields::parse(req.url_params.get("fields"), fields, unknown)) {
+                crow::json::wvalue error;
+                error["error"] = "Unknown field: " + unknown;
+                return crow::response(400, error);
+            }
+
+            std::string etag = versionTag(db.dataVersion());
+            if (etagMatches(req.get_header_value("If-None-Match"), etag) && db.carExists(id)) return notModified(etag);
+
+            crow::response res;
+            if (fields == CarFields::All) {
+                FragmentCache::Fragment fragment = cachedCar(db, id);
+                if (!fragment) {
+                    crow::json::wvalue error;
+                    error["error"] = "Car not found";
+                    return crow::response(404, error);
+                }
+
+                res = crow::response(200, *fragment);
+                res.set_header("Content-Type", "application/json");
+            } else {
+                bool found = false;
+                Car car = db.getCarById(id, found, fields);
+
+                if (!found) {
+                    crow::json::wvalue error;
+                    error["error"] = "Car not found";
+                    return crow::response(404, error);
+                }
+
+                res = carResponse(200, car, fields);
+            }
 
-            if (!found) {
+            res.set_header("ETag", "\"" + etag + "\"");
+            res.set_header("Cache-Control", "no-cache");
+            return res;
+        }));
+
+        // GET image bytes. The URL handed out in JSON carries ?v=<content hash>,
+        // so responses for a matching v never change and are cached as immutable.
+        CROW_ROUTE(app, "/api/cars/<int>/image").methods("GET"_method)
+        (offload<int>(db, [&db](const crow::request& req, int id) {
+            ImageInfo info;
+            if (!db.getCarImageInfo(id, info)) {
                 crow::json::wvalue error;
-                error["error"] = "Car not found";
+                error["error"] = "Image not found";
                 return crow::response(404, error);
             }
 
-            crow::json::wvalue response;
-            response["id"] = car.getCarId();
-            response["make"] = car.getMake();
-            response["model"] = car.getModel();
-            response["year"] = car.getYear();
-            response["price"] = car.getPrice();
-            response["mileageKm"] = car.getMileage();
-            response["color"] = car.getColor();
-            response["vin"] = car.getVin();
-            response["imageDataUrl"] = car.getImageDataUrl(); 
-            response["createdAt"] = car.getCreatedAt();
-            response["updatedAt"] = car.getUpdatedAt();
+            const char* version = req.url_params.get("v");
+            bool pinned = version && info.hash == version;
 
-            return crow::response(200, response);
-        });
+            crow::response res;
+            res.set_header("ETag", "\"" + info.hash + "\"");
+            res.set_header("Cache-Control", pinned ? "public, max-age=31536000, immutable" : "no-cache");
+            res.set_header("Accept-Ranges", "bytes");
+
+            if (etagMatches(req.get_header_value("If-None-Match"), info.hash)) {
+                res.code = 304;
+                return res;
+            }
+
+            int64_t offset = 0;
+            int64_t length = info.size;
+            const std::string& range = req.get_header_value("Range");
+            if (!range.empty()) {
+                if (!parseByteRange(range, info.size, offset, length)) {
+                    res.code = 416;
+                    res.set_header("Content-Range", "bytes */" + std::to_string(info.size));
+                    return res;
+                }
+                res.code = 206;
+                res.set_header("Content-Range", "bytes " + std::to_string(offset) + "-" +
+                               std::to_string(offset + length - 1) + "/" + std::to_string(info.size));
+            }
+
+            if (!db.readImage(info, offset, length, res.body)) {
+                crow::json::wvalue error;
+                error["error"] = "Failed to read image";
+                return crow::response(500, error);
+            }
+
+            // Older rows may predate the type check; never let a stored type
+            // turn the response into something a browser would render
+            res.set_header("Content-Type", ImageStore::allowedType(info.mimeType) ? info.mimeType : "application/octet-stream");
+            res.set_header("X-Content-Type-Options", "nosniff");
+            return res;
+        }));
 
         // POST create
         CROW_ROUTE(app, "/api/cars").methods("POST"_method)
-        ([&db, getString, getInt, getDouble](const crow::request& req) {
-            auto body = crow::json::load(req.body);
-            if (!body) {
+        (offload(db, [&db](const crow::request& req) {
+            Car car;
+            uint32_t present = 0;
+            std::string invalid;
+            if (!CarPayload::parse(req.body, car, present, invalid)) {
                 crow::json::wvalue error;
-                error["error"] = "Invalid JSON";
+                error["error"] = invalid;
                 return crow::response(400, error);
             }
 
-            if (!body.has("make") || !body.has("model") || !body.has("year") || !body.has("price") || !body.has("mileageKm")) {
+            if ((present & RequiredFields) != RequiredFields) {
                 crow::json::wvalue error;
                 error["error"] = "Missing required fields: make, model, year, price, mileageKm";
                 return crow::response(400, error);
             }
 
-            Car car;
-            car.setMake(StringUtils::toTitleCase(getString(body, "make")));          
-            car.setModel(StringUtils::toTitleCase(getString(body, "model")));         
-            car.setYear(getInt(body, "year"));
-            car.setPrice(getDouble(body, "price"));
-            car.setMileage(getInt(body, "mileageKm"));
-
-            car.setColor(StringUtils::toTitleCase(getString(body, "color")));         
-            car.setVin(StringUtils::toUpperCase(getString(body, "vin")));             
-            car.setImageDataUrl(getString(body, "imageDataUrl")); 
-
-            int newId = 0;
-            if (!db.insertCar(car, newId)) {
+            normalize(car);
+
+            Car createdCar;
+            WriteResult result = db.insertCar(car, createdCar);
+            if (result == WriteResult::Invalid) {
+                crow::json::wvalue error;
+                error["error"] = "imageDataUrl must be a base64 PNG, JPEG, GIF or WebP data URL";
+                return crow::response(400, error);
+            }
+            if (result == WriteResult::Conflict) {
+                crow::json::wvalue error;
+                error["error"] = "A car with this VIN already exists";
+                return crow::response(409, error);
+            }
+            if (result != WriteResult::Ok) {
                 crow::json::wvalue error;
-                error["error"] = "Failed to create car (possible duplicate VIN)";
+                error["error"] = "Failed to create car";
                 return crow::response(500, error);
             }
 
-            bool found = false;
-            Car createdCar = db.getCarById(newId, found);
-
-            crow::json::wvalue response;
-            response["id"] = createdCar.getCarId();
-            response["make"] = createdCar.getMake();
-            response["model"] = createdCar.getModel();
-            response["year"] = createdCar.getYear();
-            response["price"] = createdCar.getPrice();
-            response["mileageKm"] = createdCar.getMileage();
-            response["color"] = createdCar.getColor();
-            response["vin"] = createdCar.getVin();
-            response["imageDataUrl"] = createdCar.getImageDataUrl(); 
-
-            auto res = crow::response(201, response);
-            res.add_header("Location", "/api/cars/" + std::to_string(newId));
+            auto res = carResponse(201, createdCar);
+            res.add_header("Location", "/api/cars/" + std::to_string(createdCar.getCarId()));
             return res;
-        });
+        }));
+
+
+        // POST form of ?ids= for lists too long for a URL: {"ids":[1,5,9]}.
+        // ?fields= applies as for GET.
+        CROW_ROUTE(app, "/api/cars/lookup").methods("POST"_method)
+        (offload(db, [&db](const crow::request& req) {
+            uint32_t fields = CarFields::All;
+            std::string unknown;
+            if (!CarFields::parse(req.url_params.get("fields"), fields, unknown)) {
+                crow::json::wvalue error;
+                error["error"] = "Unknown field: " + unknown;
+                return crow::response(400, error);
+            }
+
+            auto body = crow::json::load(req.body);
+            bool valid = body && body.t() == crow::json::type::Object && body.has("ids") &&
+                         body["ids"].t() == crow::json::type::List && body["ids"].size() <= MaxLookupIds;
 
+            std::vector<int> ids;
+            if (valid) {
+                for (const auto& item : body["ids"]) {
+                    if (item.t() != crow::json::type::Number || item.nt() == crow::json::num_type::Floating_point ||
+                        item.i() <= 0 || item.i() > INT_MAX) {
+                        valid = false;
+                        break;
+                    }
+                    ids.push_back(static_cast<int>(item.i()));
+                }
+            }
+            if (!valid) {
+                crow::json::wvalue error;
+                error["error"] = "Body must be {\"ids\":[...]} with up to " + std::to_string(MaxLookupIds) + " car ids";
+                return crow::response(400, error);
+            }
+
+            return multiGet(db, ids, fields);
+        }));
+
+        // POST bulk create from a JSON array of cars or NDJSON (one car per line).
+        // Every row is validated and inserted on its own; the response lists
+        // each row's outcome by index, e.g. {"index":3,"status":201,"id":57}
+        // or {"index":4,"status":409,"error":"..."}.
+        CROW_ROUTE(app, "/api/cars/batch").methods("POST"_method)
+        (offload(db, [&db](const crow::request& req) {
+            std::vector<Car> cars;
+            std::vector<size_t> rowOf;                 // index in the body of each entry in cars
+            std::vector<std::pair<int, std::string>> outcome;  // status and error per row
+            std::string invalid;
+
+            bool ok = CarPayload::forEachItem(req.body, [&](const char* begin, const char* end) {
+                size_t index = outcome.size();
+                outcome.emplace_back(0, std::string());
+                if (index >= MaxBatchRows) return;
+
+                Car car;
+                uint32_t present = 0;
+                std::string error;
+                if (!CarPayload::parse(begin, end, car, present, error)) {
+                    outcome[index] = {400, error};
+                } else if ((present & RequiredFields) != RequiredFields) {
+                    outcome[index] = {400, "Missing required fields: make, model, year, price, mileageKm"};
+                } else {
+                    normalize(car);
+                    cars.push_back(std::move(car));
+                    rowOf.push_back(index);
+                }
+            }, invalid);
+
+            if (!ok) {
+                crow::json::wvalue error;
+                error["error"] = invalid;
+                return crow::response(400, error);
+            }
+            if (outcome.size() > MaxBatchRows) {
+                crow::json::wvalue error;
+                error["error"] = "A batch may hold at most " + std::to_string(MaxBatchRows) + " cars";
+                return crow::response(413, error);
+            }
+
+            std::vector<BatchRow> rows;
+            db.insertCars(cars, rows);
+
+            size_t created = 0;
+            std::vector<int> ids(outcome.size(), 0);
+            for (size_t i = 0; i < rows.size(); i++) {
+                auto& row = outcome[rowOf[i]];
+                switch (rows[i].result) {
+                    case WriteResult::Ok: row.first = 201; ids[rowOf[i]] = rows[i].id; created++; break;
+                    case WriteResult::Conflict: row = {409, "A car with this VIN already exists"}; break;
+                    case WriteResult::Invalid: row = {400, "imageDataUrl must be a base64 PNG, JPEG, GIF or WebP data URL"}; break;
+                    default: row = {500, "Failed to create car"}; break;
+                }
+            }
+
+            crow::response res(200);
+            res.set_header("Content-Type", "application/json");
+            res.body = "{\"created\":" + std::to_string(created) +
+                       ",\"failed\":" + std::to_string(outcome.size() - created) + ",\"results\":[";
+            for (size_t i = 0; i < outcome.size(); i++) {
+                if (i) res.body += ',';
+                res.body += "{\"index\":" + std::to_string(i) + ",\"status\":" + std::to_string(outcome[i].first);
+                if (outcome[i].first == 201) {
+                    res.body += ",\"id\":" + std::to_string(ids[i]);
+                } else {
+                    res.body += ",\"error\":";
+                    CarJson::appendString(res.body, outcome[i].second);
+                }
+                res.body += '}';
+            }
+            res.body += "]}";
+            return res;
+        }));
 
         // PATCH which is a partial update of the car resource. Only the fields present in the request body will be updated, allowing for more flexible updates without requiring the client to send the entire car object.
 CROW_ROUTE(app, "/api/cars/<int>").methods("PATCH"_method)
-([&db, getString, getInt, getDouble](const crow::request& req, int id) {
-    if (!db.carExists(id)) {
+(offload<int>(db, [&db](const crow::request& req, int id) {
+    Car patch;
+    uint32_t present = 0;
+    std::string invalid;
+    if (!CarPayload::parse(req.body, patch, present, invalid)) {
+        crow::json::wvalue error;
+        error["error"] = invalid;
+        return crow::response(400, error);
+    }
+
+    // Only the columns present in the request body are written
+    Car updatedCar;
+    WriteResult result = db.updateCar(id, patch, present, updatedCar);
+    if (result == WriteResult::NotFound) {
         crow::json::wvalue error;
         error["error"] = "Car not found";
         return crow::response(404, error);
     }
-
-    auto body = crow::json::load(req.body);
-    if (!body) {
+    if (result == WriteResult::Invalid) {
         crow::json::wvalue error;
-        error["error"] = "Invalid JSON";
+        error["error"] = "imageDataUrl must be a base64 PNG, JPEG, GIF or WebP data URL";
         return crow::response(400, error);
     }
-
-    // Get existing car
-    bool found = false;
-    Car car = db.getCarById(id, found);
-
-    // Only updates the fields that are present in the request body
-    if (body.has("make")) car.setMake(getString(body, "make"));
-    if (body.has("model")) car.setModel(getString(body, "model"));
-    if (body.has("year")) car.setYear(getInt(body, "year"));
-    if (body.has("price")) car.setPrice(getDouble(body, "price"));
-    if (body.has("mileageKm")) car.setMileage(getInt(body, "mileageKm"));
-    if (body.has("color")) car.setColor(getString(body, "color"));
-    if (body.has("vin")) car.setVin(getString(body, "vin"));
-    if (body.has("imageDataUrl")) car.setImageDataUrl(getString(body, "imageDataUrl"));
-
-    if (!db.updateCar(id, car)) {
+    if (result == WriteResult::Conflict) {
+        crow::json::wvalue error;
+        error["error"] = "A car with this VIN already exists";
+        return crow::response(409, error);
+    }
+    if (result != WriteResult::Ok) {
         crow::json::wvalue error;
         error["error"] = "Failed to update car";
         return crow::response(500, error);
     }
 
-    Car updatedCar = db.getCarById(id, found);
-    crow::json::wvalue response;
-    response["id"] = updatedCar.getCarId();
-    response["make"] = updatedCar.getMake();
-    response["model"] = updatedCar.getModel();
-    response["year"] = updatedCar.getYear();
-    response["price"] = updatedCar.getPrice();
-    response["mileageKm"] = updatedCar.getMileage();
-    response["color"] = updatedCar.getColor();
-    response["vin"] = updatedCar.getVin();
-    response["imageDataUrl"] = updatedCar.getImageDataUrl();
-
-    return crow::response(200, response);
-});
+    return carResponse(200, updatedCar);
+}));
 
 // OPTIONS 
 CROW_ROUTE(app, "/api/cars").methods("OPTIONS"_method)
@@ -203,65 +645,55 @@ CROW_ROUTE(app, "/api/cars/<int>").methods("OPTIONS"_method)
 
         // PUT update
        CROW_ROUTE(app, "/api/cars/<int>").methods("PUT"_method)
-        ([&db, getString, getInt, getDouble](const crow::request& req, int id) {
-            if (!db.carExists(id)) {
-                crow::json::wvalue error;
-                error["error"] = "Car not found";
-                return crow::response(404, error);
-            }
-
-            auto body = crow::json::load(req.body);
-            if (!body) {
+        (offload<int>(db, [&db](const crow::request& req, int id) {
+            Car car;
+            uint32_t present = 0;
+            std::string invalid;
+            if (!CarPayload::parse(req.body, car, present, invalid)) {
                 crow::json::wvalue error;
-                error["error"] = "Invalid JSON";
+                error["error"] = invalid;
                 return crow::response(400, error);
             }
 
-            if (!body.has("make") || !body.has("model") || !body.has("year") || !body.has("price") || !body.has("mileageKm")) {
+            if ((present & RequiredFields) != RequiredFields) {
                 crow::json::wvalue error;
                 error["error"] = "Missing required fields: make, model, year, price, mileageKm";
                 return crow::response(400, error);
             }
 
-           Car car;
             car.setCarId(id);
-            car.setMake(StringUtils::toTitleCase(getString(body, "make")));           
-            car.setModel(StringUtils::toTitleCase(getString(body, "model")));           
-            car.setYear(getInt(body, "year"));
-            car.setPrice(getDouble(body, "price"));
-            car.setMileage(getInt(body, "mileageKm"));
+            normalize(car);
 
-            car.setColor(StringUtils::toTitleCase(getString(body, "color")));         
-            car.setVin(StringUtils::toUpperCase(getString(body, "vin")));             
-            car.setImageDataUrl(getString(body, "imageDataUrl")); 
-
-
-            if (!db.updateCar(id, car)) {
+            // Every stored column is replaced; the image only when sent
+            Car updatedCar;
+            WriteResult result = db.updateCar(id, car, ReplacedFields | (present & CarFields::Image), updatedCar);
+            if (result == WriteResult::NotFound) {
                 crow::json::wvalue error;
-                error["error"] = "Failed to update car (possible duplicate VIN)";
+                error["error"] = "Car not found";
+                return crow::response(404, error);
+            }
+            if (result == WriteResult::Invalid) {
+                crow::json::wvalue error;
+                error["error"] = "imageDataUrl must be a base64 PNG, JPEG, GIF or WebP data URL";
+                return crow::response(400, error);
+            }
+            if (result == WriteResult::Conflict) {
+                crow::json::wvalue error;
+                error["error"] = "A car with this VIN already exists";
+                return crow::response(409, error);
+            }
+            if (result != WriteResult::Ok) {
+                crow::json::wvalue error;
+                error["error"] = "Failed to update car";
                 return crow::response(500, error);
             }
 
-            bool found = false;
-            Car updatedCar = db.getCarById(id, found);
-
-            crow::json::wvalue response;
-            response["id"] = updatedCar.getCarId();
-            response["make"] = updatedCar.getMake();
-            response["model"] = updatedCar.getModel();
-            response["year"] = updatedCar.getYear();
-            response["price"] = updatedCar.getPrice();
-            response["mileageKm"] = updatedCar.getMileage();
-            response["color"] = updatedCar.getColor();
-            response["vin"] = updatedCar.getVin();
-            response["imageDataUrl"] = updatedCar.getImageDataUrl(); 
-
-            return crow::response(200, response);
-        });
+            return carResponse(200, updatedCar);
+        }));
 
         // DELETE
         CROW_ROUTE(app, "/api/cars/<int>").methods("DELETE"_method)
-        ([&db](int id) {
+        (offload<int>(db, [&db](const crow::request&, int id) {
             if (!db.carExists(id)) {
                 crow::json::wvalue error;
                 error["error"] = "Car not found";
@@ -273,6 +705,530 @@ CROW_ROUTE(app, "/api/cars/<int>").methods("OPTIONS"_method)
                 return crow::response(500, error);
             }
             return crow::response(204);
+        }));
+    }
+
+private:
+    // Wraps a handler so it runs on the database executor instead of the HTTP
+    // thread, which returns as soon as the work is queued. The response is
+    // handed back to the connection's own I/O thread to be sent, as Crow
+    // expects; when the queue is full the request is answered 503 right away.
+    // A handler that throws gets a 500, as Crow gives its own handlers.
+    template <typename... Args, typename Handler>
+    static std::function<void(const crow::request&, crow::response&, Args...)> offload(Database& db, Handler handler) {
+        return [&db, handler](const crow::request& req, crow::response& res, Args... args) {
+            dispatch(db, req, res, [handler, &req, args...](std::string&) { return handler(req, args...); });
+        };
+    }
+
+    // Like offload, for a handler that answers with a file it wrote itself.
+    // It names the file in its second argument, and the file is removed once
+    // it has been sent (or the request failed).
+    static std::function<void(const crow::request&, crow::response&)> offloadFile(
+        Database& db, std::function<crow::response(const crow::request&, std::string& file)> handler) {
+        return [&db, handler](const crow::request& req, crow::response& res) {
+            dispatch(db, req, res, [handler, &req](std::string& file) { return handler(req, file); });
+        };
+    }
+
+    using Work = std::function<crow::response(std::string& file)>;
+
+    static void dispatch(Database& db, const crow::request& req, crow::response& res, Work work) {
+        // req and res stay valid until res.end(): the connection holds them.
+        // Ending from outside the handler relies on the local Crow patch in
+        // third_party/crow/PATCHES.md.
+        bool queued = db.executor().submit([work, &req, &res]() {
+            std::string file;
+            crow::response result;
+            try {
+                result = work(file);
+            } catch (const std::exception& e) {
+                std::cerr << "Handler for " << req.url << " threw: " << e.what() << std::endl;
+                result = crow::response(500);
+            } catch (...) {
+                std::cerr << "Handler for " << req.url << " threw" << std::endl;
+                result = crow::response(500);
+            }
+            asio::post(*req.io_context, [&res, result = std::move(result), file]() mutable {
+                res = std::move(result);
+                res.end();
+                // Crow writes a file response out synchronously inside end(),
+                // so by now it has been sent and closed
+                if (!file.empty()) {
+                    std::error_code ignored;
+                    std::filesystem::remove(file, ignored);
+                }
+            });
         });
+        if (queued) return;
+
+        crow::json::wvalue error;
+        error["error"] = "Server busy, try again shortly";
+        res = crow::response(503, error);
+        res.set_header("Retry-After", "1");
+        res.end();
+    }
+
+    static bool etagMatches(const std::string& ifNoneMatch, const std::string& tag) {
+        if (ifNoneMatch.empty()) return false;
+        if (ifNoneMatch == "*") return true;
+        return ifNoneMatch.find("\"" + tag + "\"") != std::string::npos;
+    }
+
+    // Car JSON is tagged with the inventory version: any committed write
+    // changes every tag, and an unchanged tag means nothing needs re-sending
+    static std::string versionTag(uint64_t version) {
+        return "v" + std::to_string(version);
+    }
+
+    static crow::response notModified(const std::string& tag) {
+        crow::response res(304);
+        res.set_header("ETag", "\"" + tag + "\"");
+        res.set_header("Cache-Control", "no-cache");
+        return res;
+    }
+
+    // Single "bytes=" range (first-last, first- or -suffix). Multiple ranges
+    // are not supported and count as unsatisfiable.
+    static bool parseByteRange(const std::string& header, int64_t size, int64_t& offset, int64_t& length) {
+        static const std::string unit = "bytes=";
+        if (header.compare(0, unit.size(), unit) != 0 || header.find(',') != std::string::npos) return false;
+
+        std::string spec = header.substr(unit.size());
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos || size <= 0) return false;
+
+        std::string first = spec.substr(0, dash);
+        std::string last = spec.substr(dash + 1);
+        char* end = nullptr;
+
+        if (first.empty()) {
+            long long suffix = std::strtoll(last.c_str(), &end, 10);
+            if (last.empty() || *end != '\0' || suffix <= 0) return false;
+            offset = suffix >= size ? 0 : size - suffix;
+            length = size - offset;
+            return true;
+        }
+
+        long long start = std::strtoll(first.c_str(), &end, 10);
+        if (*end != '\0' || start < 0 || start >= size) return false;
+
+        long long stop = size - 1;
+        if (!last.empty()) {
+            stop = std::strtoll(last.c_str(), &end, 10);
+            if (*end != '\0' || stop < start) return false;
+            if (stop >= size) stop = size - 1;
+        }
+
+        offset = start;
+        length = stop - start + 1;
+        return true;
+    }
+
+    // Writes store make/model/color in Title Case and VINs upper-cased
+    static void normalize(Car& car) {
+        car.setMake(StringUtils::toTitleCase(car.getMake()));
+        car.setModel(StringUtils::toTitleCase(car.getModel()));
+        car.setColor(StringUtils::toTitleCase(car.getColor()));
+        car.setVin(StringUtils::toUpperCase(car.getVin()));
+    }
+
+    static constexpr size_t CacheChunk = 256;
+
+    // Full JSON for one car, from the cache or serialized and cached on a miss.
+    // nullptr if the car doesn't exist.
+    static FragmentCache::Fragment cachedCar(Database& db, int id) {
+        FragmentCache& cache = db.jsonCache();
+        if (FragmentCache::Fragment fragment = cache.get(id)) return fragment;
+
+        uint64_t version = cache.version(id);
+        bool found = false;
+        Car car = db.getCarById(id, found);
+        if (!found) return nullptr;
+
+        auto fragment = std::make_shared<const std::string>(CarJson::toString(car));
+        cache.put(id, fragment, version);
+        return fragment;
+    }
+
+    // Appends the full JSON of each car in ids, in order and comma-separated.
+    // Misses are read with one query per chunk; ids with no car are skipped,
+    // and listed in absent if given.
+    static bool appendCached(Database& db, const std::vector<int>& ids, std::string& out, bool& first,
+                             std::vector<int>* absent = nullptr) {
+        FragmentCache& cache = db.jsonCache();
+        std::vector<FragmentCache::Fragment> chunk;
+        std::vector<int> missing;
+        std::vector<uint64_t> versions;
+
+        for (size_t start = 0; start < ids.size(); start += CacheChunk) {
+            size_t count = std::min(CacheChunk, ids.size() - start);
+            chunk.assign(count, nullptr);
+            missing.clear();
+            versions.clear();
+
+            for (size_t i = 0; i < count; i++) {
+                chunk[i] = cache.get(ids[start + i]);
+                if (!chunk[i]) {
+                    missing.push_back(ids[start + i]);
+                    versions.push_back(cache.version(ids[start + i]));
+                }
+            }
+
+            if (!missing.empty()) {
+                std::vector<Car> cars;
+                if (!db.getCarsByIds(missing, cars)) return false;
+
+                std::unordered_map<int, FragmentCache::Fragment> loaded;
+                for (const Car& car : cars) {
+                    auto fragment = std::make_shared<const std::string>(CarJson::toString(car));
+                    loaded[car.getCarId()] = fragment;
+                }
+                for (size_t i = 0; i < missing.size(); i++) {
+                    auto found = loaded.find(missing[i]);
+                    if (found != loaded.end()) cache.put(missing[i], found->second, versions[i]);
+                }
+                for (size_t i = 0; i < count; i++) {
+                    if (chunk[i]) continue;
+                    auto found = loaded.find(ids[start + i]);
+                    if (found != loaded.end()) chunk[i] = found->second;
+                }
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                if (!chunk[i]) {
+                    if (absent) absent->push_back(ids[start + i]);
+                    continue;
+                }
+                if (!first) out += ',';
+                first = false;
+                out += *chunk[i];
+            }
+        }
+        return true;
+    }
+
+    // {"items":[...],"missing":[...]}: the cars in ids in the order asked for,
+    // then the ids that have none. Full rows come from the JSON cache; a
+    // projection is read with one query.
+    static crow::response multiGet(Database& db, const std::vector<int>& ids, uint32_t fields) {
+        std::string body = "{\"items\":[";
+        std::vector<int> missing;
+        bool first = true;
+
+        bool ok = true;
+        if (fields == CarFields::All) {
+            ok = appendCached(db, ids, body, first, &missing);
+        } else {
+            std::vector<Car> cars;
+            ok = db.getCarsByIds(ids, cars, fields);
+
+            std::unordered_map<int, size_t> byId;
+            for (size_t i = 0; i < cars.size(); i++) byId[cars[i].getCarId()] = i;
+            for (int id : ids) {
+                auto found = byId.find(id);
+                if (found == byId.end()) {
+                    missing.push_back(id);
+                    continue;
+                }
+                if (!first) body += ',';
+                first = false;
+                CarJson::write(cars[found->second], fields, body);
+            }
+        }
+        if (!ok) {
+            crow::json::wvalue error;
+            error["error"] = "Failed to load cars";
+            return crow::response(500, error);
+        }
+
+        body += "],\"missing\":[";
+        for (size_t i = 0; i < missing.size(); i++) {
+            if (i) body += ',';
+            body += std::to_string(missing[i]);
+        }
+        body += "]}";
+
+        crow::response res(200);
+        res.set_header("Content-Type", "application/json");
+        res.body = std::move(body);
+        return res;
+    }
+
+    // "1,5,9": positive ids, at most MaxLookupIds of them
+    static bool parseIds(const char* text, std::vector<int>& ids) {
+        const char* start = text;
+        while (true) {
+            const char* end = std::strchr(start, ',');
+            std::string item = end ? std::string(start, end - start) : std::string(start);
+
+            int id = 0;
+            if (!parsePositiveInt(item.c_str(), id) || ids.size() >= MaxLookupIds) return false;
+            ids.push_back(id);
+
+            if (!end) return true;
+            start = end + 1;
+        }
+    }
+
+    // Single car body, written by CarJson
+    static crow::response carResponse(int code, const Car& car, uint32_t fields = CarFields::All) {
+        crow::response res(code);
+        res.set_header("Content-Type", "application/json");
+        CarJson::write(car, fields, res.body);
+        return res;
+    }
+
+    // Writes every car to a new file under ExportDir, buffering ExportChunk
+    // bytes at a time. The partial file is removed if anything fails.
+    static bool spoolExport(Database& db, bool csv, uint32_t fields, std::string& path) {
+        static std::atomic<uint64_t> exports{0};
+
+        std::error_code error;
+        std::filesystem::create_directories(ExportDir, error);
+        path = std::string(ExportDir) + "/cars-" + std::to_string(std::time(nullptr)) + "-" +
+               std::to_string(exports.fetch_add(1)) + (csv ? ".csv" : ".ndjson");
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        std::string chunk;
+        chunk.reserve(ExportChunk + 1024);
+        if (csv) CarCsv::writeHeader(fields, chunk);
+
+        bool ok = db.scanCars(fields, [&](const Car& car) {
+            if (csv) {
+                CarCsv::write(car, fields, chunk);
+            } else {
+                CarJson::write(car, fields, chunk);
+                chunk += '\n';
+            }
+            if (chunk.size() >= ExportChunk) {
+                file.write(chunk.data(), chunk.size());
+                chunk.clear();
+            }
+        });
+        file.write(chunk.data(), chunk.size());
+        file.close();
+
+        if (!ok || !file) {
+            std::filesystem::remove(path, error);
+            return false;
+        }
+        return true;
+    }
+
+    // Removes spool files older than ExportRetention: ones whose request died
+    // with the process. A live export is far younger; on POSIX a file still
+    // being read survives removal anyway.
+    static void sweepExports() {
+        std::error_code error;
+        auto cutoff = std::filesystem::file_time_type::clock::now() - ExportRetention;
+        for (const auto& entry : std::filesystem::directory_iterator(ExportDir, error)) {
+            std::error_code ignored;
+            if (entry.is_regular_file(ignored) && entry.last_write_time(ignored) < cutoff) {
+                std::filesystem::remove(entry.path(), ignored);
+            }
+        }
+    }
+
+    static uint64_t subscriberId(crow::websocket::connection& conn) {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(conn.userdata()));
+    }
+
+    // One stream event; the car is the row as committed, without the data URL
+    static std::string changeEvent(const CarChange& change) {
+        static const char* types[] = {"created", "updated", "deleted"};
+
+        std::string event = "{\"type\":\"";
+        event += types[static_cast<int>(change.kind)];
+        event += "\",\"version\":" + std::to_string(change.seq) + ",\"id\":" + std::to_string(change.id);
+        if (change.kind != CarChange::Kind::Deleted) {
+            event += ",\"car\":";
+            CarJson::write(change.after, CarFields::All, event);
+        }
+        event += '}';
+        return event;
+    }
+
+    static bool parseVersion(const char* text, uint64_t& value) {
+        if (*text < '0' || *text > '9') return false;
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long parsed = std::strtoull(text, &end, 10);
+        if (*end != '\0' || errno == ERANGE) return false;
+        value = parsed;
+        return true;
+    }
+
+    // {"version":V,"changed":[cars],"deleted":[ids]} for everything written
+    // after since. Rows newer than version may be included; applying them
+    // twice is harmless, so the client simply continues from version.
+    static crow::response changesSince(Database& db, uint64_t since, uint64_t version, uint32_t fields) {
+        std::vector<Car> changed;
+        std::vector<int> deleted;
+        if (!db.getChangesSince(since, changed, deleted)) {
+            crow::json::wvalue error;
+            error["error"] = "Failed to load changes";
+            return crow::response(500, error);
+        }
+
+        // Checked after the read: a purge that ran first removed tombstones
+        // this delta needed
+        if (since < db.historyStart()) {
+            crow::json::wvalue error;
+            error["error"] = "since is older than the retained change history; reload the full listing";
+            return crow::response(410, error);
+        }
+
+        crow::response res(200);
+        res.set_header("Content-Type", "application/json");
+        res.set_header("ETag", "\"" + versionTag(version) + "\"");
+        res.set_header("Cache-Control", "no-cache");
+
+        res.body = "{\"version\":" + std::to_string(version) + ",\"changed\":[";
+        for (size_t i = 0; i < changed.size(); i++) {
+            if (i) res.body += ',';
+            CarJson::write(changed[i], fields, res.body);
+        }
+        res.body += "],\"deleted\":[";
+        for (size_t i = 0; i < deleted.size(); i++) {
+            if (i) res.body += ',';
+            res.body += std::to_string(deleted[i]);
+        }
+        res.body += "]}";
+        return res;
+    }
+
+    static bool parsePositiveInt(const char* text, int& value) {
+        char* end = nullptr;
+        long parsed = std::strtol(text, &end, 10);
+        if (end == text || *end != '\0' || parsed <= 0 || parsed > INT_MAX) return false;
+        value = static_cast<int>(parsed);
+        return true;
+    }
+
+    static bool parseNumber(const char* text, double& value) {
+        char* end = nullptr;
+        value = std::strtod(text, &end);
+        return end != text && *end == '\0' && std::isfinite(value);
+    }
+
+    static bool parseInt(const char* text, int& value) {
+        char* end = nullptr;
+        long parsed = std::strtol(text, &end, 10);
+        if (end == text || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX) return false;
+        value = static_cast<int>(parsed);
+        return true;
+    }
+
+    // Reads the filter and sort parameters. Text filters are normalized the
+    // same way writes normalize them, so ?make=ford matches "Ford".
+    static bool parseQuery(const crow::request& req, CarQuery& query, std::string& error) {
+        if (const char* make = req.url_params.get("make")) query.make = StringUtils::toTitleCase(make);
+        if (const char* model = req.url_params.get("model")) query.model = StringUtils::toTitleCase(model);
+        if (const char* color = req.url_params.get("color")) query.color = StringUtils::toTitleCase(color);
+
+        struct NumberParam { const char* name; std::optional<double>* value; };
+        for (const NumberParam& param : {NumberParam{"minPrice", &query.minPrice}, NumberParam{"maxPrice", &query.maxPrice}}) {
+            const char* text = req.url_params.get(param.name);
+            if (!text) continue;
+            double value = 0;
+            if (!parseNumber(text, value)) {
+                error = std::string(param.name) + " must be a number";
+                return false;
+            }
+            *param.value = value;
+        }
+
+        struct IntParam { const char* name; std::optional<int>* value; };
+        for (const IntParam& param : {IntParam{"minYear", &query.minYear}, IntParam{"maxYear", &query.maxYear},
+                                      IntParam{"maxMileage", &query.maxMileage}}) {
+            const char* text = req.url_params.get(param.name);
+            if (!text) continue;
+            int value = 0;
+            if (!parseInt(text, value)) {
+                error = std::string(param.name) + " must be an integer";
+                return false;
+            }
+            *param.value = value;
+        }
+
+        const char* sort = req.url_params.get("sort");
+        if (sort && *sort && !CarQuery::parseSort(sort, query.sort)) {
+            error = std::string("Unknown sort: ") + sort;
+            return false;
+        }
+        return true;
+    }
+
+    // The request's own URL with limit and cursor replaced, so filters, sort
+    // and fields carry over to the next page
+    static std::string nextPageUrl(const crow::request& req, int limit, const std::string& cursor) {
+        std::string url = req.url + "?limit=" + std::to_string(limit) + "&cursor=" + cursor;
+
+        size_t query = req.raw_url.find('?');
+        if (query == std::string::npos) return url;
+
+        size_t start = query + 1;
+        while (start < req.raw_url.size()) {
+            size_t end = req.raw_url.find('&', start);
+            if (end == std::string::npos) end = req.raw_url.size();
+
+            std::string pair = req.raw_url.substr(start, end - start);
+            std::string name = pair.substr(0, pair.find('='));
+            if (!pair.empty() && name != "limit" && name != "cursor") url += "&" + pair;
+
+            start = end + 1;
+        }
+        return url;
+    }
+
+    // Cursors are opaque to clients: base64url, unpadded, of "c1:<last id>" for
+    // the default order, or "c2:<sort>:<last sort key>:<last id>" otherwise.
+    // The sort is embedded so a cursor can't be replayed against another order.
+    static std::string encodeCursor(CarSort sort, const Car& last) {
+        std::string raw;
+        if (sort == CarSort::Id) {
+            raw = "c1:" + std::to_string(last.getCarId());
+        } else {
+            double key = 0;
+            if (sort == CarSort::PriceAsc || sort == CarSort::PriceDesc) key = last.getPrice();
+            else if (sort == CarSort::YearAsc || sort == CarSort::YearDesc) key = last.getYear();
+            else key = last.getMileage();
+
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.17g", key);
+            raw = std::string("c2:") + CarQuery::sortName(sort) + ":" + buffer + ":" + std::to_string(last.getCarId());
+        }
+
+        std::string token = crow::utility::base64encode_urlsafe(raw, raw.size());
+        while (!token.empty() && token.back() == '=') token.pop_back();
+        return token;
+    }
+
+    static bool decodeCursor(const std::string& token, CarQuery& query) {
+        std::string raw = crow::utility::base64decode(token, token.size());
+
+        std::string idText;
+        if (raw.compare(0, 3, "c1:") == 0) {
+            if (query.sort != CarSort::Id) return false;
+            idText = raw.substr(3);
+        } else if (raw.compare(0, 3, "c2:") == 0) {
+            size_t sortEnd = raw.find(':', 3);
+            size_t keyEnd = sortEnd == std::string::npos ? sortEnd : raw.find(':', sortEnd + 1);
+            if (keyEnd == std::string::npos) return false;
+
+            CarSort sort;
+            if (!CarQuery::parseSort(raw.substr(3, sortEnd - 3), sort) || sort != query.sort || sort == CarSort::Id) return false;
+            if (!parseNumber(raw.substr(sortEnd + 1, keyEnd - sortEnd - 1).c_str(), query.afterKey)) return false;
+            idText = raw.substr(keyEnd + 1);
+        } else {
+            return false;
+        }
+
+        if (!parseInt(idText.c_str(), query.afterId) || query.afterId < 0) return false;
+        query.hasAfter = true;
+        return true;
     }
-};
+};
\ No newline at end of file
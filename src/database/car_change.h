@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include "../../Models/Car.h"
+
+// A committed write to the cars table, published after its batch is durable.
+// before is the row as it was (Updated/Deleted), after the row as written
+// (Inserted/Updated); the other side is left default-constructed. seq is the
+// change sequence the write stamped on the row, which is also the data
+// version once its batch is published.
+struct CarChange {
+    enum class Kind { Inserted, Updated, Deleted };
+
+    Kind kind;
+    int id;
+    Car before;
+    Car after;
+    uint64_t seq = 0;
+};
+
+using CarChangeListener = std::function<void(const CarChange& change)>;
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Bitmask over the attributes of a car, used to project reads down to what a
+// caller asked for (?fields=). The same mask picks the SQL columns and the
+// JSON members, so unrequested columns are neither read nor serialized.
+class CarFields {
+public:
+    enum : uint32_t {
+        Id        = 1u << 0,
+        Make      = 1u << 1,
+        Model     = 1u << 2,
+        Year      = 1u << 3,
+        Price     = 1u << 4,
+        Mileage   = 1u << 5,
+        Color     = 1u << 6,
+        Vin       = 1u << 7,
+        Image     = 1u << 8,
+        CreatedAt = 1u << 9,
+        UpdatedAt = 1u << 10,
+        All       = (1u << 11) - 1
+    };
+
+    struct Field {
+        uint32_t bit;
+        const char* name;     // JSON member
+        const char* column;   // cars column backing it
+    };
+
+    static constexpr size_t Count = 11;
+
+    // In SELECT order
+    static const Field* list() {
+        static const Field fields[Count] = {
+            {Id, "id", "id"},
+            {Make, "make", "make"},
+            {Model, "model", "model"},
+            {Year, "year", "year"},
+            {Price, "price", "price"},
+            {Mileage, "mileageKm", "mileage_km"},
+            {Color, "color", "color"},
+            {Vin, "vin", "vin"},
+            {Image, "imageUrl", "image_hash"},
+            {CreatedAt, "createdAt", "created_at"},
+            {UpdatedAt, "updatedAt", "updated_at"},
+        };
+        return fields;
+    }
+
+    // Parses a comma-separated list of JSON member names. A missing or empty
+    // list means every field; an unknown name fails and is reported in unknown.
+    static bool parse(const char* text, uint32_t& mask, std::string& unknown) {
+        mask = 0;
+        if (!text || !*text) {
+            mask = All;
+            return true;
+        }
+
+        const char* start = text;
+        while (true) {
+            const char* end = std::strchr(start, ',');
+            size_t length = end ? static_cast<size_t>(end - start) : std::strlen(start);
+
+            if (length > 0) {
+                uint32_t bit = lookup(start, length);
+                if (!bit) {
+                    unknown.assign(start, length);
+                    return false;
+                }
+                mask |= bit;
+            }
+
+            if (!end) break;
+            start = end + 1;
+        }
+
+        if (!mask) mask = All;
+        return true;
+    }
+
+    // SELECT list for a mask. id is always selected: it is the rowid, so it
+    // costs nothing to read, and cursors and image URLs are built from it.
+    static std::string columns(uint32_t mask) {
+        std::string sql;
+        const Field* fields = list();
+        for (size_t i = 0; i < Count; i++) {
+            if (fields[i].bit != Id && !(mask & fields[i].bit)) continue;
+            if (!sql.empty()) sql += ", ";
+            sql += fields[i].column;
+        }
+        return sql;
+    }
+
+private:
+    static uint32_t lookup(const char* name, size_t length) {
+        const Field* fields = list();
+        for (size_t i = 0; i < Count; i++) {
+            if (std::strlen(fields[i].name) == length && std::strncmp(fields[i].name, name, length) == 0) {
+                return fields[i].bit;
+            }
+        }
+        return 0;
+    }
+};
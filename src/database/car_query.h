@@ -0,0 +1,65 @@
+#pragma once
+#include <optional>
+#include <string>
+
+// Sort orders GET /api/cars understands. Ties are broken by id in the same
+// direction, so every order is total and can be paged with a keyset cursor.
+enum class CarSort { Id, PriceAsc, PriceDesc, YearAsc, YearDesc, MileageAsc, MileageDesc };
+
+// Filters, order and keyset position of a car listing. Database compiles it
+// into one parameterized SELECT; unset members add no condition.
+struct CarQuery {
+    std::string make;
+    std::string model;
+    std::string color;
+    std::optional<double> minPrice;
+    std::optional<double> maxPrice;
+    std::optional<int> minYear;
+    std::optional<int> maxYear;
+    std::optional<int> maxMileage;
+
+    CarSort sort = CarSort::Id;
+
+    // Resume after the row with this sort key and id (keyset pagination).
+    // For CarSort::Id only afterId is used.
+    bool hasAfter = false;
+    double afterKey = 0;
+    int afterId = 0;
+
+    // "price-asc", "year-desc", ... as used by the frontend's sort selector
+    static bool parseSort(const std::string& name, CarSort& sort) {
+        for (const auto& entry : sorts()) {
+            if (name == entry.name) {
+                sort = entry.sort;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static const char* sortName(CarSort sort) {
+        for (const auto& entry : sorts()) {
+            if (entry.sort == sort) return entry.name;
+        }
+        return "id";
+    }
+
+private:
+    struct SortName {
+        CarSort sort;
+        const char* name;
+    };
+
+    static const SortName (&sorts())[7] {
+        static const SortName names[7] = {
+            {CarSort::Id, "id"},
+            {CarSort::PriceAsc, "price-asc"},
+            {CarSort::PriceDesc, "price-desc"},
+            {CarSort::YearAsc, "year-asc"},
+            {CarSort::YearDesc, "year-desc"},
+            {CarSort::MileageAsc, "mileage-asc"},
+            {CarSort::MileageDesc, "mileage-desc"},
+        };
+        return names;
+    }
+};
@@ -0,0 +1,113 @@
+#include "car_replica.h"
+#include <algorithm>
+
+static bool idLess(const CarSnapshot::CarPtr& car, int id) { return car->getCarId() < id; }
+
+const Car* CarSnapshot::find(int id) const {
+    auto found = std::lower_bound(cars.begin(), cars.end(), id, idLess);
+    return found != cars.end() && (*found)->getCarId() == id ? found->get() : nullptr;
+}
+
+static bool matches(const CarQuery& query, const Car& car) {
+    if (!query.make.empty() && car.getMake() != query.make) return false;
+    if (!query.model.empty() && car.getModel() != query.model) return false;
+    if (!query.color.empty() && car.getColor() != query.color) return false;
+    if (query.minPrice && car.getPrice() < *query.minPrice) return false;
+    if (query.maxPrice && car.getPrice() > *query.maxPrice) return false;
+    if (query.minYear && car.getYear() < *query.minYear) return false;
+    if (query.maxYear && car.getYear() > *query.maxYear) return false;
+    if (query.maxMileage && car.getMileage() > *query.maxMileage) return false;
+    return true;
+}
+
+static double sortKey(CarSort sort, const Car& car) {
+    switch (sort) {
+        case CarSort::PriceAsc: case CarSort::PriceDesc: return car.getPrice();
+        case CarSort::YearAsc: case CarSort::YearDesc: return car.getYear();
+        case CarSort::MileageAsc: case CarSort::MileageDesc: return car.getMileage();
+        default: return car.getCarId();
+    }
+}
+
+void CarSnapshot::forEach(const CarQuery& query, int limit, const std::function<void(const Car&)>& visit) const {
+    size_t wanted = limit > 0 ? static_cast<size_t>(limit) : cars.size();
+
+    if (query.sort == CarSort::Id) {
+        auto it = query.hasAfter ? std::upper_bound(cars.begin(), cars.end(), query.afterId,
+                                                    [](int id, const CarPtr& car) { return id < car->getCarId(); })
+                                 : cars.begin();
+        for (size_t emitted = 0; it != cars.end() && emitted < wanted; ++it) {
+            if (!matches(query, **it)) continue;
+            visit(**it);
+            emitted++;
+        }
+        return;
+    }
+
+    bool descending = query.sort == CarSort::PriceDesc || query.sort == CarSort::YearDesc ||
+                      query.sort == CarSort::MileageDesc;
+
+    // (key, id) in the requested direction, as the SQL ORDER BY does
+    auto before = [&](const Car* a, const Car* b) {
+        double ka = sortKey(query.sort, *a), kb = sortKey(query.sort, *b);
+        if (ka != kb) return descending ? ka > kb : ka < kb;
+        return descending ? a->getCarId() > b->getCarId() : a->getCarId() < b->getCarId();
+    };
+
+    std::vector<const Car*> selected;
+    for (const CarPtr& car : cars) {
+        if (!matches(query, *car)) continue;
+        if (query.hasAfter) {
+            double key = sortKey(query.sort, *car);
+            bool past = key != query.afterKey ? (descending ? key < query.afterKey : key > query.afterKey)
+                                              : (descending ? car->getCarId() < query.afterId : car->getCarId() > query.afterId);
+            if (!past) continue;
+        }
+        selected.push_back(car.get());
+    }
+
+    if (wanted < selected.size()) {
+        std::partial_sort(selected.begin(), selected.begin() + wanted, selected.end(), before);
+        selected.resize(wanted);
+    } else {
+        std::sort(selected.begin(), selected.end(), before);
+    }
+
+    for (const Car* car : selected) visit(*car);
+}
+
+CarReplica::CarReplica() : current(std::make_shared<const CarSnapshot>()) {}
+
+void CarReplica::load(const std::vector<Car>& cars) {
+    auto snapshot = std::make_shared<CarSnapshot>();
+    snapshot->cars.reserve(cars.size());
+    for (const Car& car : cars) snapshot->cars.push_back(std::make_shared<const Car>(car));
+
+    std::sort(snapshot->cars.begin(), snapshot->cars.end(),
+              [](const CarSnapshot::CarPtr& a, const CarSnapshot::CarPtr& b) { return a->getCarId() < b->getCarId(); });
+
+    std::atomic_store(&current, std::shared_ptr<const CarSnapshot>(std::move(snapshot)));
+}
+
+void CarReplica::apply(const std::vector<CarChange>& changes) {
+    if (changes.empty()) return;
+
+    // One copy per batch: the vector of pointers is copied, the cars are shared
+    auto next = std::make_shared<CarSnapshot>(*std::atomic_load(&current));
+    std::vector<CarSnapshot::CarPtr>& cars = next->cars;
+
+    for (const CarChange& change : changes) {
+        auto at = std::lower_bound(cars.begin(), cars.end(), change.id, idLess);
+        bool present = at != cars.end() && (*at)->getCarId() == change.id;
+
+        if (change.kind == CarChange::Kind::Deleted) {
+            if (present) cars.erase(at);
+        } else if (present) {
+            *at = std::make_shared<const Car>(change.after);
+        } else {
+            cars.insert(at, std::make_shared<const Car>(change.after));
+        }
+    }
+
+    std::atomic_store(&current, std::shared_ptr<const CarSnapshot>(std::move(next)));
+}
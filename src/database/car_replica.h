@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "car_change.h"
+#include "car_query.h"
+
+// One immutable version of the whole cars table, ordered by id. Cars are
+// shared between consecutive snapshots; only changed rows are new.
+class CarSnapshot {
+public:
+    using CarPtr = std::shared_ptr<const Car>;
+
+    const Car* find(int id) const;
+    size_t size() const { return cars.size(); }
+    const std::vector<CarPtr>& all() const { return cars; }
+
+    // Same rows and order the SQL listing produces for query: filters, sort
+    // (ties by id), keyset position and limit (<= 0 for all)
+    void forEach(const CarQuery& query, int limit, const std::function<void(const Car&)>& visit) const;
+
+private:
+    friend class CarReplica;
+    std::vector<CarPtr> cars;
+};
+
+// In-memory copy of the cars table. Loaded once at startup, then kept in
+// step by applying committed changes in commit order on the writer thread;
+// SQLite stays the durable source of truth. A writer builds the next
+// snapshot off to the side and swaps it in (RCU style); readers only copy
+// the current shared_ptr. That copy is not lock-free: libstdc++ implements
+// std::atomic_load/atomic_store on shared_ptr with a small global pool of
+// spin locks, held just for the pointer copy and refcount bump. Readers
+// never wait on the writer's rebuild or on SQLite, only on each other for
+// those few instructions. (The free functions are deprecated in C++20 in
+// favour of std::atomic<std::shared_ptr>, which this C++17 build can't use.)
+class CarReplica {
+public:
+    CarReplica();
+
+    // Replace the contents wholesale (startup)
+    void load(const std::vector<Car>& cars);
+
+    // Writer thread only
+    void apply(const std::vector<CarChange>& changes);
+
+    std::shared_ptr<const CarSnapshot> snapshot() const { return std::atomic_load(&current); }
+
+private:
+    std::shared_ptr<const CarSnapshot> current;
+};
@@ -0,0 +1,130 @@
+#include "change_feed.h"
+#include <iostream>
+#include <iterator>
+
+ChangeFeed::ChangeFeed(size_t window) : maxUnacked(window ? window : 1) {}
+
+ChangeFeed::~ChangeFeed() { stop(); }
+
+void ChangeFeed::start() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (running) return;
+
+    running = true;
+    stopping = false;
+    dispatcher = std::thread(&ChangeFeed::run, this);
+}
+
+void ChangeFeed::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) return;
+        stopping = true;
+    }
+    hasEvents.notify_all();
+
+    if (dispatcher.joinable()) dispatcher.join();
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    running = false;
+}
+
+uint64_t ChangeFeed::subscribe(Send send, Drop drop, const Hello& hello) {
+    // Held while sending hello, so the dispatcher can't deliver anything first
+    std::lock_guard<std::mutex> lock(subscriberMutex);
+    uint64_t id = nextId++;
+    auto& subscriber = subscriberMap.emplace(id, Subscriber{std::move(send), std::move(drop), {}}).first->second;
+    subscriber.send(hello());
+    return id;
+}
+
+void ChangeFeed::unsubscribe(uint64_t id) {
+    std::lock_guard<std::mutex> lock(subscriberMutex);
+    subscriberMap.erase(id);
+}
+
+void ChangeFeed::acknowledge(uint64_t id, uint64_t seq) {
+    std::lock_guard<std::mutex> lock(subscriberMutex);
+    auto found = subscriberMap.find(id);
+    if (found == subscriberMap.end()) return;
+
+    auto& unacked = found->second.unacked;
+    while (!unacked.empty() && unacked.front() <= seq) unacked.pop_front();
+}
+
+void ChangeFeed::publish(uint64_t seq, std::string message) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running || stopping) return;
+
+        if (pending.size() >= MaxPending) {
+            pending.clear();
+            overflowed = true;
+        }
+        pending.push_back(Event{seq, std::make_shared<const std::string>(std::move(message))});
+    }
+    publishedCount.fetch_add(1, std::memory_order_relaxed);
+    hasEvents.notify_one();
+}
+
+size_t ChangeFeed::subscribers() const {
+    std::lock_guard<std::mutex> lock(subscriberMutex);
+    return subscriberMap.size();
+}
+
+void ChangeFeed::run() {
+    std::vector<Event> batch;
+
+    while (true) {
+        bool dropAll = false;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            hasEvents.wait(lock, [this] { return stopping || !pending.empty(); });
+
+            if (pending.empty()) return; // stopping and fully delivered
+
+            batch.assign(std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+            pending.clear();
+            dropAll = overflowed;
+            overflowed = false;
+        }
+
+        deliver(batch, dropAll);
+        batch.clear();
+    }
+}
+
+void ChangeFeed::deliver(const std::vector<Event>& events, bool dropAll) {
+    std::lock_guard<std::mutex> lock(subscriberMutex);
+
+    // Events were discarded unseen: nobody's stream is complete any more
+    if (dropAll && !subscriberMap.empty()) {
+        std::cerr << "Change feed fell behind; dropping " << subscriberMap.size() << " subscriber(s)" << std::endl;
+        for (auto& entry : subscriberMap) entry.second.drop();
+        droppedCount.fetch_add(subscriberMap.size(), std::memory_order_relaxed);
+        subscriberMap.clear();
+    }
+
+    for (auto it = subscriberMap.begin(); it != subscriberMap.end();) {
+        Subscriber& subscriber = it->second;
+
+        bool keep = true;
+        for (const Event& event : events) {
+            if (subscriber.unacked.size() >= maxUnacked) {
+                keep = false;
+                break;
+            }
+            subscriber.send(*event.message);
+            subscriber.unacked.push_back(event.seq);
+        }
+
+        if (keep) {
+            ++it;
+            continue;
+        }
+
+        subscriber.drop();
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+        it = subscriberMap.erase(it);
+    }
+}
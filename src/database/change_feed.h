@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Fan-out of change events to push subscribers (the WebSocket stream).
+// publish() only queues the message; a dispatcher thread hands it to every
+// subscriber, so the writer thread never waits on a client. Each subscriber
+// may have at most window events outstanding, i.e. sent but not yet
+// acknowledged; one that falls further behind is dropped instead of letting
+// its backlog grow.
+class ChangeFeed {
+public:
+    static constexpr size_t DefaultWindow = 256;
+
+    // Events waiting for the dispatcher; past this every subscriber is dropped
+    // (they would otherwise miss events) and must resync
+    static constexpr size_t MaxPending = 4096;
+
+    // Both run on the dispatcher thread and must not block
+    using Send = std::function<void(const std::string& message)>;
+    using Drop = std::function<void()>;
+    // Builds the first message a subscriber gets
+    using Hello = std::function<std::string()>;
+
+    explicit ChangeFeed(size_t window = DefaultWindow);
+    ~ChangeFeed();
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    void start();
+    // Delivers what is already queued, then stops the dispatcher
+    void stop();
+
+    // Registers the subscriber and sends it hello() before any event. hello
+    // runs after registration, so events it doesn't account for are still
+    // delivered; the subscriber may also see events hello already covers.
+    // Returns the subscriber id. Call unsubscribe once the connection is gone;
+    // a dropped subscriber is already removed by then.
+    uint64_t subscribe(Send send, Drop drop, const Hello& hello);
+    void unsubscribe(uint64_t id);
+
+    // The subscriber has processed every event up to and including seq
+    void acknowledge(uint64_t id, uint64_t seq);
+
+    // seq must grow from call to call (the change sequence does)
+    void publish(uint64_t seq, std::string message);
+
+    size_t window() const { return maxUnacked; }
+    size_t subscribers() const;
+    uint64_t published() const { return publishedCount.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Event {
+        uint64_t seq;
+        std::shared_ptr<const std::string> message;
+    };
+
+    struct Subscriber {
+        Send send;
+        Drop drop;
+        std::deque<uint64_t> unacked;
+    };
+
+    size_t maxUnacked;
+
+    std::mutex queueMutex;
+    std::condition_variable hasEvents;
+    std::deque<Event> pending;
+    bool overflowed = false;
+    bool running = false;
+    bool stopping = false;
+    std::thread dispatcher;
+
+    mutable std::mutex subscriberMutex;
+    std::unordered_map<uint64_t, Subscriber> subscriberMap;
+    uint64_t nextId = 1;
+
+    std::atomic<uint64_t> publishedCount{0};
+    std::atomic<uint64_t> droppedCount{0};
+
+    void run();
+    void deliver(const std::vector<Event>& events, bool dropAll);
+};
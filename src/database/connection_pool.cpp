@@ -0,0 +1,174 @@
+#include "connection_pool.h"
+#include <iostream>
+#include <thread>
+
+// Lease
+
+ConnectionPool::Lease::Lease(ConnectionPool* pool, Slot* slot, bool writer)
+    : pool(pool), slot(slot), writer(writer) {}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : pool(other.pool), slot(other.slot), writer(other.writer) {
+    other.pool = nullptr;
+    other.slot = nullptr;
+}
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        slot = other.slot;
+        writer = other.writer;
+        other.pool = nullptr;
+        other.slot = nullptr;
+    }
+    return *this;
+}
+
+ConnectionPool::Lease::~Lease() { release(); }
+
+void ConnectionPool::Lease::release() {
+    if (pool && slot) {
+        if (writer) pool->releaseWriter();
+        else pool->releaseReader(slot);
+    }
+    pool = nullptr;
+    slot = nullptr;
+}
+
+int ConnectionPool::Lease::execute(const std::string& sql) const {
+    CachedStatement stmt = prepare(sql);
+    if (!stmt) return sqlite3_errcode(get());
+
+    return sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_extended_errcode(get());
+}
+
+// Pool
+
+ConnectionPool::ConnectionPool(const std::string& dbPath, size_t readerCount)
+    : dbPath(dbPath), requestedReaders(readerCount) {
+    if (requestedReaders == 0) {
+        requestedReaders = std::thread::hardware_concurrency();
+        if (requestedReaders == 0) requestedReaders = 4;
+    }
+}
+
+ConnectionPool::~ConnectionPool() { close(); }
+
+std::unique_ptr<ConnectionPool::Slot> ConnectionPool::openConnection(bool readOnly) {
+    // Every connection is used by one thread at a time (guarded by the lease),
+    // so SQLite's own per-connection mutex is unnecessary
+    int flags = SQLITE_OPEN_NOMUTEX;
+    flags |= readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(dbPath.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to open the database: " << (db ? sqlite3_errmsg(db) : "out of memory") << std::endl;
+        sqlite3_close(db);
+        return nullptr;
+    }
+
+    sqlite3_busy_timeout(db, 5000);
+
+    auto slot = std::make_unique<Slot>();
+    slot->db = db;
+    slot->statements = std::make_unique<StatementCache>(db, counters);
+    return slot;
+}
+
+void ConnectionPool::closeSlot(Slot& slot) {
+    // Cached statements have to be finalized before the handle can close
+    slot.statements.reset();
+    sqlite3_close(slot.db);
+    slot.db = nullptr;
+}
+
+bool ConnectionPool::open() {
+    writer = openConnection(false);
+    if (!writer) return false;
+
+    // WAL lets readers run concurrently with the single writer; the journal mode
+    // is stored in the database file so the readers pick it up as well.
+    // synchronous stays FULL so a commit is on disk before it is acknowledged;
+    // the write queue's group commit keeps that to one fsync per batch.
+    const char* pragmas =
+        "PRAGMA journal_mode = WAL;"
+        "PRAGMA synchronous = FULL;"
+        "PRAGMA foreign_keys = ON;";
+
+    char* errorMessage = nullptr;
+    if (sqlite3_exec(writer->db, pragmas, nullptr, nullptr, &errorMessage) != SQLITE_OK) {
+        std::cerr << "Failed to configure the database: " << (errorMessage ? errorMessage : "unknown") << std::endl;
+        sqlite3_free(errorMessage);
+        close();
+        return false;
+    }
+
+    for (size_t i = 0; i < requestedReaders; i++) {
+        auto reader = openConnection(true);
+        if (!reader) {
+            close();
+            return false;
+        }
+        idleReaders.push_back(reader.get());
+        readers.push_back(std::move(reader));
+    }
+
+    return true;
+}
+
+void ConnectionPool::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& reader : readers) closeSlot(*reader);
+        readers.clear();
+        idleReaders.clear();
+
+        if (writer) {
+            closeSlot(*writer);
+            writer.reset();
+        }
+    }
+
+    // Wake anyone still waiting so they see the pool is closed
+    readerAvailable.notify_all();
+    writerAvailable.notify_all();
+}
+
+ConnectionPool::Lease ConnectionPool::acquireReader() {
+    std::unique_lock<std::mutex> lock(mutex);
+    readerAvailable.wait(lock, [this] { return !idleReaders.empty() || readers.empty(); });
+
+    if (idleReaders.empty()) return Lease();
+
+    Slot* slot = idleReaders.back();
+    idleReaders.pop_back();
+    return Lease(this, slot, false);
+}
+
+ConnectionPool::Lease ConnectionPool::acquireWriter() {
+    std::unique_lock<std::mutex> lock(mutex);
+    writerAvailable.wait(lock, [this] { return !writerBusy || !writer; });
+
+    if (!writer) return Lease();
+
+    writerBusy = true;
+    return Lease(this, writer.get(), true);
+}
+
+void ConnectionPool::releaseReader(Slot* slot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idleReaders.push_back(slot);
+    }
+    readerAvailable.notify_one();
+}
+
+void ConnectionPool::releaseWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writerBusy = false;
+    }
+    writerAvailable.notify_one();
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <sqlite3.h>
+#include "statement_cache.h"
+
+// Pool of SQLite connections for one database file: a single writer plus
+// N read-only readers, all opened in WAL mode so readers never block on the writer.
+// Each connection carries its own prepared-statement cache.
+class ConnectionPool {
+    struct Slot {
+        sqlite3* db = nullptr;
+        std::unique_ptr<StatementCache> statements;
+    };
+
+public:
+    // RAII handle to a pooled connection, handed back to the pool on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(ConnectionPool* pool, Slot* slot, bool writer);
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        sqlite3* get() const { return slot ? slot->db : nullptr; }
+        explicit operator bool() const { return slot != nullptr; }
+
+        // Borrow the cached prepared statement for sql on this connection
+        CachedStatement prepare(const std::string& sql) const { return slot->statements->acquire(sql); }
+
+        // Step the cached statement for sql, which returns no rows (transaction
+        // control, savepoints). SQLITE_OK, or the extended error code.
+        int execute(const std::string& sql) const;
+
+    private:
+        ConnectionPool* pool = nullptr;
+        Slot* slot = nullptr;
+        bool writer = false;
+
+        void release();
+    };
+
+    // readerCount of 0 means one reader per hardware thread
+    ConnectionPool(const std::string& dbPath, size_t readerCount = 0);
+    ~ConnectionPool();
+
+    // Open the writer (creating the file if needed) and then the readers
+    bool open();
+    void close();
+
+    // Blocks until a connection of the requested kind is free
+    Lease acquireReader();
+    Lease acquireWriter();
+
+    size_t readerCount() const { return readers.size(); }
+
+    // Prepared-statement cache hits/misses summed over every connection
+    uint64_t statementCacheHits() const { return counters.hits.load(std::memory_order_relaxed); }
+    uint64_t statementCacheMisses() const { return counters.misses.load(std::memory_order_relaxed); }
+    uint64_t statementCacheEvictions() const { return counters.evictions.load(std::memory_order_relaxed); }
+
+private:
+    std::string dbPath;
+    size_t requestedReaders;
+
+    StatementCache::Counters counters;
+
+    std::unique_ptr<Slot> writer;
+    bool writerBusy = false;
+    std::vector<std::unique_ptr<Slot>> readers;
+    std::vector<Slot*> idleReaders;
+
+    std::mutex mutex;
+    std::condition_variable readerAvailable;
+    std::condition_variable writerAvailable;
+
+    std::unique_ptr<Slot> openConnection(bool readOnly);
+    void closeSlot(Slot& slot);
+    void releaseReader(Slot* slot);
+    void releaseWriter();
+};
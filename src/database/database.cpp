@@ -1,32 +1,107 @@
 #include "database.h"
 #include <iostream>
 #include <ctime>
+#include <chrono>
+#include <algorithm>
 
 // Constructor
-Database::Database(const std::string& dbPath) : db(nullptr), dbPath(dbPath) {}
+Database::Database(const std::string& dbPath, size_t readerCount, size_t jsonCacheBytes, bool inMemoryReads)
+    : dbPath(dbPath), pool(dbPath, readerCount), writes(pool), fragments(jsonCacheBytes), inMemoryReads(inMemoryReads) {}
 
 // Destructor
 Database::~Database() { close(); }
 
-// Helper function to get current timestamp
-static std::string getCurrentTimestamp() {
-    time_t now = time(0);
+// Helper function to format a timestamp the way the table stores them
+static std::string formatTimestamp(time_t when) {
     struct tm tstruct;
     char buf[80];
-    tstruct = *localtime(&now); 
+    tstruct = *localtime(&when); 
     strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tstruct);
     return buf;
 }
 
-bool Database::initialize() {
-    int result = sqlite3_open(dbPath.c_str(), &db);
+// Helper function to get current timestamp
+static std::string getCurrentTimestamp() {
+    return formatTimestamp(time(0));
+}
 
-    if (result != SQLITE_OK) {
-        std::cerr << "Failed to open the database: " << sqlite3_errmsg(db) << std::endl;
-        return false;
+// Fills car from a row selected with CarFields::columns(fields). Columns are
+// read in CarFields order; fields outside the mask are left as they were, so a
+// Car reused across rows keeps its string capacity.
+static void readCar(sqlite3_stmt* stmt, uint32_t fields, Car& car) {
+    const CarFields::Field* list = CarFields::list();
+
+    int column = 0;
+    for (size_t i = 0; i < CarFields::Count; i++) {
+        uint32_t bit = list[i].bit;
+        if (bit != CarFields::Id && !(fields & bit)) continue;
+
+        int index = column++;
+        if (bit == CarFields::Id) { car.setCarId(sqlite3_column_int(stmt, index)); continue; }
+        if (bit == CarFields::Year) { car.setYear(sqlite3_column_int(stmt, index)); continue; }
+        if (bit == CarFields::Price) { car.setPrice(sqlite3_column_double(stmt, index)); continue; }
+        if (bit == CarFields::Mileage) { car.setMileage(sqlite3_column_int(stmt, index)); continue; }
+
+        const unsigned char* txt = sqlite3_column_text(stmt, index);
+        std::string value = txt ? reinterpret_cast<const char*>(txt) : "";
+
+        switch (bit) {
+            case CarFields::Make: car.setMake(value); break;
+            case CarFields::Model: car.setModel(value); break;
+            case CarFields::Color: car.setColor(value); break;
+            case CarFields::Vin: car.setVin(value); break;
+            case CarFields::Image: car.setImageHash(value); break;
+            case CarFields::CreatedAt: car.setCreatedAt(value); break;
+            case CarFields::UpdatedAt: car.setUpdatedAt(value); break;
+        }
+    }
+}
+
+static Car readCar(sqlite3_stmt* stmt, uint32_t fields) {
+    Car car;
+    readCar(stmt, fields, car);
+    return car;
+}
+
+// "SELECT <projection> FROM cars WHERE <live> <rest>", where rest goes on with
+// "AND ..." or "ORDER BY ...": tombstones are never read as cars. The full
+// projection is by far the most common, so its text is built once; the
+// statement cache keys on the text either way, so every distinct projection
+// is prepared only once per connection.
+static std::string selectCars(uint32_t fields, const char* rest) {
+    static const std::string allColumns = CarFields::columns(CarFields::All);
+    return "SELECT " + ((fields & CarFields::All) == CarFields::All ? allColumns : CarFields::columns(fields)) +
+           " FROM cars WHERE deleted_at IS NULL " + rest;
+}
+
+// First column of a single-row query, or 0
+static uint64_t queryUint64(const ConnectionPool::Lease& conn, const char* sql) {
+    sqlite3_stmt* stmt = nullptr;
+    uint64_t value = 0;
+    if (sqlite3_prepare_v2(conn.get(), sql, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        value = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
     }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+// Current row for id, read inside a mutation so a change can report what it replaced
+static bool readCurrent(const ConnectionPool::Lease& conn, int id, Car& car) {
+    CachedStatement stmt = conn.prepare(selectCars(CarFields::All, "AND id = ?;"));
+    if (!stmt) return false;
 
-    std::cout << "Database opened successfully: " << dbPath << std::endl;
+    sqlite3_bind_int(stmt, 1, id);
+    if (sqlite3_step(stmt) != SQLITE_ROW) return false;
+
+    car = readCar(stmt, CarFields::All);
+    return true;
+}
+
+bool Database::initialize() {
+    if (!pool.open()) return false;
+
+    std::cout << "Database opened successfully: " << dbPath
+              << " (WAL, 1 writer + " << pool.readerCount() << " readers)" << std::endl;
 
     std::string createTableSQL = R"(
         CREATE TABLE IF NOT EXISTS cars (
@@ -43,30 +118,166 @@ bool Database::initialize() {
             updated_at TEXT NOT NULL
         );
 
+        CREATE TABLE IF NOT EXISTS images (
+            hash TEXT PRIMARY KEY,
+            mime_type TEXT NOT NULL,
+            data BLOB NOT NULL
+        );
+
+        CREATE TABLE IF NOT EXISTS sync_state (
+            name TEXT PRIMARY KEY,
+            value INTEGER NOT NULL
+        );
+
         CREATE INDEX IF NOT EXISTS idx_cars_make_model ON cars(make, model);
         CREATE INDEX IF NOT EXISTS idx_cars_year ON cars(year);
+        CREATE INDEX IF NOT EXISTS idx_cars_model ON cars(model);
+        CREATE INDEX IF NOT EXISTS idx_cars_color ON cars(color);
+        CREATE INDEX IF NOT EXISTS idx_cars_price ON cars(price);
+        CREATE INDEX IF NOT EXISTS idx_cars_mileage ON cars(mileage_km);
         CREATE UNIQUE INDEX IF NOT EXISTS idx_cars_vin ON cars(vin) WHERE vin IS NOT NULL;
     )";
 
-    return executeSQL(createTableSQL);
+    if (!executeSQL(createTableSQL)) return false;
+
+    // Columns added after the first release
+    if (!columnExists("cars", "image_hash") &&
+        !executeSQL("ALTER TABLE cars ADD COLUMN image_hash TEXT REFERENCES images(hash);")) {
+        return false;
+    }
+    if (!executeSQL("CREATE INDEX IF NOT EXISTS idx_cars_image_hash ON cars(image_hash);")) return false;
+
+    // Rows from before change tracking count as written at sequence 1
+    if (!columnExists("cars", "change_seq") &&
+        !executeSQL("ALTER TABLE cars ADD COLUMN change_seq INTEGER NOT NULL DEFAULT 1;")) {
+        return false;
+    }
+    if (!columnExists("cars", "deleted_at") &&
+        !executeSQL("ALTER TABLE cars ADD COLUMN deleted_at TEXT;")) {
+        return false;
+    }
+    if (!executeSQL("CREATE INDEX IF NOT EXISTS idx_cars_change_seq ON cars(change_seq);"
+                    "CREATE INDEX IF NOT EXISTS idx_cars_deleted_at ON cars(deleted_at) WHERE deleted_at IS NOT NULL;")) {
+        return false;
+    }
+
+    uint64_t highestSeq = 0;
+    {
+        auto conn = pool.acquireWriter();
+        if (!conn || !ImageStore::migrateLegacy(conn)) return false;
+        if (!facetIndex.load(conn)) return false;
+
+        highestSeq = queryUint64(conn, "SELECT MAX(change_seq) FROM cars;");
+        purgedThrough.store(queryUint64(conn, "SELECT value FROM sync_state WHERE name = 'purged_through';"),
+                            std::memory_order_release);
+    }
+
+    if (inMemoryReads) {
+        replica.load(getAllCars());
+        replicated = true;
+        std::cout << "Loaded " << replica.snapshot()->size() << " car(s) into memory" << std::endl;
+    }
+
+    // Sequences continue from the clock as well as from what is stored, so they
+    // don't repeat after a restart even when the newest tombstones were purged
+    uint64_t clock = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    lastSeq = std::max({clock, highestSeq, historyStart()});
+    version.store(lastSeq, std::memory_order_release);
+
+    writes.onBatchCommitted([this]() {
+        // Taken out first, so a throwing listener can't leave them to be published again
+        std::vector<CarChange> changes;
+        changes.swap(committedChanges);
+        publish(changes);
+    });
+    feed.start();
+    writes.start();
+    // Reads are capped by the reader pool; writes mostly wait on group commit
+    tasks.start(pool.readerCount() * 2);
+
+    purgeStopping = false;
+    purger = std::thread(&Database::runPurger, this);
+    return true;
 }
 
-// Insert
-bool Database::insertCar(const Car& car, int& newId) {
-    std::string timestamp = getCurrentTimestamp();
+// Maps the SQLite code a mutation finished with onto the caller-facing result
+static WriteResult toWriteResult(int code) {
+    if (code == SQLITE_OK) return WriteResult::Ok;
+    if (code == SQLITE_NOTFOUND) return WriteResult::NotFound;
+    if ((code & 0xff) == SQLITE_CONSTRAINT) return WriteResult::Conflict;
+    if (code == SQLITE_MISMATCH) return WriteResult::Invalid;
+    return WriteResult::Failed;
+}
+
+// Decodes the car's data URL, if any, ahead of queueing the write.
+// Returns false when the data URL is not a usable base64 image.
+static bool decodeImage(const Car& car, ImageUpload& upload, bool& hasUpload) {
+    hasUpload = !car.getImageDataUrl().empty();
+    return !hasUpload || ImageStore::decode(car.getImageDataUrl(), upload);
+}
 
-    std::string sql =
-        "INSERT INTO cars (make, model, year, price, mileage_km, color, vin, image_data_url, created_at, updated_at) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+// The columns a write stores, without the (possibly huge) data URL it came with
+static Car storedFields(const Car& car) {
+    Car stored;
+    stored.setMake(car.getMake());
+    stored.setModel(car.getModel());
+    stored.setYear(car.getYear());
+    stored.setPrice(car.getPrice());
+    stored.setMileage(car.getMileage());
+    stored.setColor(car.getColor());
+    stored.setVin(car.getVin());
+    return stored;
+}
 
-    sqlite3_stmt* stmt = nullptr;
-    int result = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+static const std::string& insertSql() {
+    static const std::string sql =
+        "INSERT INTO cars (make, model, year, price, mileage_km, color, vin, created_at, updated_at, change_seq) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    return sql;
+}
 
-    if (result != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << std::endl;
-        return false;
+// " RETURNING <every CarFields column>", so a write hands back the row as stored
+static const std::string& returningAll() {
+    static const std::string sql = " RETURNING " + CarFields::columns(CarFields::All);
+    return sql;
+}
+
+// Columns a car write sets from the request, in CarFields order
+struct StoredColumn {
+    uint32_t bit;
+    const char* name;
+};
+
+static const std::vector<StoredColumn>& storedColumns() {
+    static const std::vector<StoredColumn> list = {
+        {CarFields::Make, "make"}, {CarFields::Model, "model"}, {CarFields::Year, "year"},
+        {CarFields::Price, "price"}, {CarFields::Mileage, "mileage_km"}, {CarFields::Color, "color"},
+        {CarFields::Vin, "vin"},
+    };
+    return list;
+}
+
+// Binds car's value for one stored column; an empty color or VIN is NULL
+static void bindColumn(sqlite3_stmt* stmt, int index, uint32_t bit, const Car& car) {
+    auto bindOptional = [&](const std::string& value) {
+        if (value.empty()) sqlite3_bind_null(stmt, index);
+        else sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_TRANSIENT);
+    };
+
+    switch (bit) {
+        case CarFields::Make: sqlite3_bind_text(stmt, index, car.getMake().c_str(), -1, SQLITE_TRANSIENT); break;
+        case CarFields::Model: sqlite3_bind_text(stmt, index, car.getModel().c_str(), -1, SQLITE_TRANSIENT); break;
+        case CarFields::Year: sqlite3_bind_int(stmt, index, car.getYear()); break;
+        case CarFields::Price: sqlite3_bind_double(stmt, index, car.getPrice()); break;
+        case CarFields::Mileage: sqlite3_bind_int(stmt, index, car.getMileage()); break;
+        case CarFields::Color: bindOptional(car.getColor()); break;
+        case CarFields::Vin: bindOptional(car.getVin()); break;
     }
+}
 
+// Binds a new row's values to the insertSql() statement
+static void bindInsert(sqlite3_stmt* stmt, const Car& car, const std::string& timestamp, uint64_t seq) {
     sqlite3_bind_text(stmt, 1, car.getMake().c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, car.getModel().c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, 3, car.getYear());
@@ -82,187 +293,467 @@ bool Database::insertCar(const Car& car, int& newId) {
     if (car.getVin().empty()) sqlite3_bind_null(stmt, 7);
     else sqlite3_bind_text(stmt, 7, car.getVin().c_str(), -1, SQLITE_TRANSIENT);
 
-    // image_data_url 
-    if (car.getImageDataUrl().empty()) sqlite3_bind_null(stmt, 8);
-    else sqlite3_bind_text(stmt, 8, car.getImageDataUrl().c_str(), -1, SQLITE_TRANSIENT);
-
+    sqlite3_bind_text(stmt, 8, timestamp.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 9, timestamp.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 10, timestamp.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 10, static_cast<sqlite3_int64>(seq));
+}
 
-    result = sqlite3_step(stmt);
+// What an insert publishes once committed
+static CarChange insertedChange(const Car& car, int id, const std::string& imageHash,
+                                const std::string& timestamp, uint64_t seq) {
+    CarChange change{CarChange::Kind::Inserted, id, Car(), storedFields(car), seq};
+    change.after.setCarId(id);
+    change.after.setImageHash(imageHash);
+    change.after.setCreatedAt(timestamp);
+    change.after.setUpdatedAt(timestamp);
+    return change;
+}
 
-    if (result != SQLITE_DONE) {
-        std::cerr << "Failed to insert car: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
-        return false;
-    }
+// Insert
+WriteResult Database::insertCar(const Car& car, Car& created) {
+    ImageUpload upload;
+    bool hasUpload = false;
+    if (!decodeImage(car, upload, hasUpload)) return WriteResult::Invalid;
 
-    newId = static_cast<int>(sqlite3_last_insert_rowid(db));
-    sqlite3_finalize(stmt);
+    std::string timestamp = getCurrentTimestamp();
+    uint64_t seq = 0;
+
+    int code = writes.submit([&](const ConnectionPool::Lease& conn) {
+        sqlite3* db = conn.get();
+        seq = ++lastSeq;
+        {
+            static const std::string sql = insertSql() + returningAll();
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) return sqlite3_errcode(db);
+
+            bindInsert(stmt, car, timestamp, seq);
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                std::cerr << "Failed to insert car: " << sqlite3_errmsg(db) << std::endl;
+                return sqlite3_extended_errcode(db);
+            }
+            created = readCar(stmt, CarFields::All);
+        }
+
+        created.setImageHash(hasUpload ? upload.hash : "");
+        return hasUpload ? ImageStore::attach(conn, created.getCarId(), &upload) : SQLITE_OK;
+    }, [&]() {
+        committedChanges.push_back(CarChange{CarChange::Kind::Inserted, created.getCarId(), Car(), created, seq});
+    });
+
+    return toWriteResult(code);
+}
 
-    return true;
+// Bulk insert: one write-queue mutation per chunk, reusing the cached INSERT
+// for every row. Each row runs under its own savepoint, so a rejected row is
+// rolled back alone and the rest of the chunk still commits.
+void Database::insertCars(const std::vector<Car>& cars, std::vector<BatchRow>& results) {
+    results.assign(cars.size(), BatchRow{WriteResult::Failed, 0});
+    std::string timestamp = getCurrentTimestamp();
+
+    for (size_t start = 0; start < cars.size(); start += BatchChunkRows) {
+        size_t end = std::min(cars.size(), start + BatchChunkRows);
+
+        // Images are decoded here, off the writer thread
+        std::vector<ImageUpload> uploads(end - start);
+        std::vector<bool> hasUpload(end - start, false);
+        for (size_t i = start; i < end; i++) {
+            bool has = false;
+            if (!decodeImage(cars[i], uploads[i - start], has)) results[i].result = WriteResult::Invalid;
+            hasUpload[i - start] = has;
+        }
+
+        std::vector<CarChange> changes;
+        int code = writes.submit([&](const ConnectionPool::Lease& conn) {
+            sqlite3* db = conn.get();
+            CachedStatement stmt = conn.prepare(insertSql());
+            if (!stmt) return sqlite3_errcode(db);
+
+            for (size_t i = start; i < end; i++) {
+                if (results[i].result == WriteResult::Invalid) continue;
+
+                int result = conn.execute("SAVEPOINT row;");
+                if (result != SQLITE_OK) return result;
+
+                uint64_t seq = ++lastSeq;
+                bindInsert(stmt, cars[i], timestamp, seq);
+                result = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_extended_errcode(db);
+                sqlite3_reset(stmt);
+
+                int id = 0;
+                if (result == SQLITE_OK) {
+                    id = static_cast<int>(sqlite3_last_insert_rowid(db));
+                    if (hasUpload[i - start]) result = ImageStore::attach(conn, id, &uploads[i - start]);
+                }
+
+                if (result != SQLITE_OK) conn.execute("ROLLBACK TO row;");
+                conn.execute("RELEASE row;");
+
+                results[i] = BatchRow{toWriteResult(result), result == SQLITE_OK ? id : 0};
+                if (result == SQLITE_OK) {
+                    std::string hash = hasUpload[i - start] ? uploads[i - start].hash : "";
+                    changes.push_back(insertedChange(cars[i], id, hash, timestamp, seq));
+                }
+            }
+            return SQLITE_OK;
+        }, [&]() {
+            for (CarChange& change : changes) committedChanges.push_back(std::move(change));
+        });
+
+        // The chunk never committed: nothing in it was stored
+        if (code != SQLITE_OK) {
+            for (size_t i = start; i < end; i++) {
+                if (results[i].result == WriteResult::Ok) results[i] = BatchRow{WriteResult::Failed, 0};
+            }
+        }
+    }
 }
 
 // Update
-bool Database::updateCar(int id, const Car& car) {
+WriteResult Database::updateCar(int id, const Car& car, uint32_t columns, Car& updated) {
+    bool replaceImage = columns & CarFields::Image;
+    ImageUpload upload;
+    bool hasUpload = false;
+    if (replaceImage && !decodeImage(car, upload, hasUpload)) return WriteResult::Invalid;
+
     std::string timestamp = getCurrentTimestamp();
+    CarChange change{CarChange::Kind::Updated, id, Car(), Car()};
+
+    int code = writes.submit([&](const ConnectionPool::Lease& conn) {
+        sqlite3* db = conn.get();
+        // The row as it was, for listeners; RETURNING only sees the new one
+        if (!readCurrent(conn, id, change.before)) return SQLITE_NOTFOUND;
+        change.seq = ++lastSeq;
+        {
+            std::string sql = "UPDATE cars SET ";
+            for (const StoredColumn& column : storedColumns()) {
+                if (columns & column.bit) sql += std::string(column.name) + " = ?, ";
+            }
+            sql += "updated_at = ?, change_seq = ? WHERE id = ? AND deleted_at IS NULL" + returningAll();
+
+            // One text per set of columns, so the statement cache holds a few variants at most
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) return sqlite3_errcode(db);
+
+            int index = 1;
+            for (const StoredColumn& column : storedColumns()) {
+                if (columns & column.bit) bindColumn(stmt, index++, column.bit, car);
+            }
+            sqlite3_bind_text(stmt, index, timestamp.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, index + 1, static_cast<sqlite3_int64>(change.seq));
+            sqlite3_bind_int(stmt, index + 2, id);
+
+            int result = sqlite3_step(stmt);
+            if (result == SQLITE_DONE) return SQLITE_NOTFOUND;
+            if (result != SQLITE_ROW) {
+                std::cerr << "Failed to update car: " << sqlite3_errmsg(db) << std::endl;
+                return sqlite3_extended_errcode(db);
+            }
+            updated = readCar(stmt, CarFields::All);
+        }
+
+        if (!replaceImage) return SQLITE_OK;
+        updated.setImageHash(hasUpload ? upload.hash : "");
+        return ImageStore::attach(conn, id, hasUpload ? &upload : nullptr);
+    }, [&]() {
+        change.after = updated;
+        committedChanges.push_back(std::move(change));
+    });
+
+    return toWriteResult(code);
+}
 
-    std::string sql =
-        "UPDATE cars SET make = ?, model = ?, year = ?, price = ?, mileage_km = ?, color = ?, vin = ?, image_data_url = ?, updated_at = ? "
-        "WHERE id = ?;";
+// Delete (soft: the row stays as a tombstone for delta sync)
+bool Database::deleteCar(int id) {
+    std::string timestamp = getCurrentTimestamp();
+    CarChange change{CarChange::Kind::Deleted, id, Car(), Car()};
+    bool existed = false;
+
+    int code = writes.submit([&](const ConnectionPool::Lease& conn) {
+        existed = readCurrent(conn, id, change.before);
+        if (!existed) return SQLITE_OK;
+        change.seq = ++lastSeq;
+
+        // Unlink the image first so it is released if no other car shares it
+        int result = ImageStore::attach(conn, id, nullptr);
+        if (result != SQLITE_OK) return result;
+
+        // The VIN is cleared so a new listing can reuse it
+        static const std::string sql =
+            "UPDATE cars SET vin = NULL, deleted_at = ?, updated_at = ?, change_seq = ? WHERE id = ?;";
+
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) return sqlite3_errcode(conn.get());
+
+        sqlite3_bind_text(stmt, 1, timestamp.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, timestamp.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(change.seq));
+        sqlite3_bind_int(stmt, 4, id);
+        return sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_extended_errcode(conn.get());
+    }, [&]() {
+        if (existed) committedChanges.push_back(std::move(change));
+    });
+
+    return code == SQLITE_OK;
+}
 
-    sqlite3_stmt* stmt = nullptr;
-    int result = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+// Get by id
+Car Database::getCarById(int id, bool& found, uint32_t fields) {
+    Car car;
+    found = false;
 
-    if (result != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << std::endl;
-        return false;
+    if (replicated) {
+        auto snapshot = replica.snapshot();
+        if (const Car* row = snapshot->find(id)) {
+            found = true;
+            car = *row;
+        }
+        return car;
     }
 
-    sqlite3_bind_text(stmt, 1, car.getMake().c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, car.getModel().c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 3, car.getYear());
-    sqlite3_bind_double(stmt, 4, car.getPrice());
-    sqlite3_bind_int(stmt, 5, car.getMileage());
+    auto conn = pool.acquireReader();
+    if (!conn) return car;
 
-    if (car.getColor().empty()) sqlite3_bind_null(stmt, 6);
-    else sqlite3_bind_text(stmt, 6, car.getColor().c_str(), -1, SQLITE_TRANSIENT);
+    CachedStatement stmt = conn.prepare(selectCars(fields, "AND id = ?;"));
+    if (!stmt) return car;
 
-    if (car.getVin().empty()) sqlite3_bind_null(stmt, 7);
-    else sqlite3_bind_text(stmt, 7, car.getVin().c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 1, id);
 
-    if (car.getImageDataUrl().empty()) sqlite3_bind_null(stmt, 8);
-    else sqlite3_bind_text(stmt, 8, car.getImageDataUrl().c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        found = true;
+        car = readCar(stmt, fields);
+    }
 
-    sqlite3_bind_text(stmt, 9, timestamp.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 10, id);
+    return car;
+}
 
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+// Get all
+std::vector<Car> Database::getAllCars(uint32_t fields) {
+    std::vector<Car> cars;
 
-    if (result != SQLITE_DONE) {
-        std::cerr << "Failed to update car: " << sqlite3_errmsg(db) << std::endl;
-        return false;
+    if (replicated) {
+        auto snapshot = replica.snapshot();
+        cars.reserve(snapshot->size());
+        for (const auto& car : snapshot->all()) cars.push_back(*car);
+        return cars;
     }
 
-    return true;
-}
-
-// Delete
-bool Database::deleteCar(int id) {
-    std::string sql = "DELETE FROM cars WHERE id = ?;";
+    auto conn = pool.acquireReader();
+    if (!conn) return cars;
 
-    sqlite3_stmt* stmt = nullptr;
-    int result = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    CachedStatement stmt = conn.prepare(selectCars(fields, "ORDER BY id;"));
+    if (!stmt) return cars;
 
-    if (result != SQLITE_OK) return false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        cars.push_back(readCar(stmt, fields));
+    }
 
-    sqlite3_bind_int(stmt, 1, id);
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    return cars;
+}
 
-    return result == SQLITE_DONE;
+// Column and CarFields bit a sort order keys on
+static const char* sortColumn(CarSort sort, uint32_t& bit) {
+    switch (sort) {
+        case CarSort::PriceAsc: case CarSort::PriceDesc: bit = CarFields::Price; return "price";
+        case CarSort::YearAsc: case CarSort::YearDesc: bit = CarFields::Year; return "year";
+        case CarSort::MileageAsc: case CarSort::MileageDesc: bit = CarFields::Mileage; return "mileage_km";
+        default: bit = CarFields::Id; return "id";
+    }
 }
 
-// Get by id
-Car Database::getCarById(int id, bool& found) {
-    Car car;
-    found = false;
+static bool sortDescending(CarSort sort) {
+    return sort == CarSort::PriceDesc || sort == CarSort::YearDesc || sort == CarSort::MileageDesc;
+}
 
-    std::string sql =
-        "SELECT id, make, model, year, price, mileage_km, color, vin, image_data_url, created_at, updated_at "
-        "FROM cars WHERE id = ?;";
+std::vector<Car> Database::findCars(const CarQuery& query, int limit, uint32_t fields) {
+    std::vector<Car> cars;
+    if (limit > 0) cars.reserve(limit);
 
-    sqlite3_stmt* stmt = nullptr;
-    int result = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    forEachCar(query, limit, fields, [&cars](const Car& car) { cars.push_back(car); });
+    return cars;
+}
 
-    if (result != SQLITE_OK) return car;
+bool Database::forEachCar(const CarQuery& query, int limit, uint32_t fields, const std::function<void(const Car&)>& visit) {
+    if (replicated) {
+        replica.snapshot()->forEach(query, limit, visit);
+        return true;
+    }
+    return queryCars(query, limit, fields, visit);
+}
 
-    sqlite3_bind_int(stmt, 1, id);
+bool Database::scanCars(uint32_t fields, const std::function<void(const Car&)>& visit) {
+    return queryCars(CarQuery(), 0, fields, visit);
+}
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        found = true;
+// Compiles the query into a single SELECT whose conditions are all bound
+// parameters, so each combination of filters is prepared once and then served
+// from the statement cache. make/model use idx_cars_make_model (or idx_cars_model),
+// the ranges and sort keys their own single-column indexes.
+bool Database::queryCars(const CarQuery& query, int limit, uint32_t fields, const std::function<void(const Car&)>& visit) {
+    struct Param {
+        const std::string* text;
+        double number;
+    };
+    std::vector<Param> params;
+    std::string where;
+
+    auto condition = [&](const char* sql) {
+        where += "AND ";
+        where += sql;
+        where += ' ';
+    };
+    auto text = [&](const char* sql, const std::string& value) {
+        if (value.empty()) return;
+        condition(sql);
+        params.push_back({&value, 0});
+    };
+    auto number = [&](const char* sql, std::optional<double> value) {
+        if (!value) return;
+        condition(sql);
+        params.push_back({nullptr, *value});
+    };
+
+    text("make = ?", query.make);
+    text("model = ?", query.model);
+    text("color = ?", query.color);
+    number("price >= ?", query.minPrice);
+    number("price <= ?", query.maxPrice);
+    number("year >= ?", query.minYear);
+    number("year <= ?", query.maxYear);
+    number("mileage_km <= ?", query.maxMileage);
+
+    // The sort key is always read so the caller can build the next cursor
+    uint32_t sortBit = CarFields::Id;
+    std::string column = sortColumn(query.sort, sortBit);
+    fields |= sortBit;
+
+    bool descending = sortDescending(query.sort);
+    if (query.hasAfter) {
+        if (query.sort == CarSort::Id) {
+            condition("id > ?");
+            params.push_back({nullptr, static_cast<double>(query.afterId)});
+        } else {
+            // Row-value comparison lets the sort index seek straight to the resume point
+            condition(("(" + column + ", id) " + (descending ? "<" : ">") + " (?, ?)").c_str());
+            params.push_back({nullptr, query.afterKey});
+            params.push_back({nullptr, static_cast<double>(query.afterId)});
+        }
+    }
 
-        car.setCarId(sqlite3_column_int(stmt, 0));
+    std::string order = "ORDER BY " + column + (descending ? " DESC" : "");
+    if (query.sort != CarSort::Id) order += descending ? ", id DESC" : ", id";
 
-        const unsigned char* makeTxt = sqlite3_column_text(stmt, 1);
-        const unsigned char* modelTxt = sqlite3_column_text(stmt, 2);
+    std::string rest = where + order + (limit > 0 ? " LIMIT ?;" : ";");
 
-        car.setMake(makeTxt ? reinterpret_cast<const char*>(makeTxt) : "");
-        car.setModel(modelTxt ? reinterpret_cast<const char*>(modelTxt) : "");
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
 
-        car.setYear(sqlite3_column_int(stmt, 3));
-        car.setPrice(sqlite3_column_double(stmt, 4));
-        car.setMileage(sqlite3_column_int(stmt, 5));
+    CachedStatement stmt = conn.prepare(selectCars(fields, rest.c_str()));
+    if (!stmt) return false;
 
-        const unsigned char* colorTxt = sqlite3_column_text(stmt, 6);
-        const unsigned char* vinTxt = sqlite3_column_text(stmt, 7);
-        const unsigned char* imgTxt = sqlite3_column_text(stmt, 8);
-        const unsigned char* createdTxt = sqlite3_column_text(stmt, 9);
-        const unsigned char* updatedTxt = sqlite3_column_text(stmt, 10);
+    int index = 1;
+    for (const Param& param : params) {
+        if (param.text) sqlite3_bind_text(stmt, index++, param.text->c_str(), -1, SQLITE_TRANSIENT);
+        else sqlite3_bind_double(stmt, index++, param.number);
+    }
+    if (limit > 0) sqlite3_bind_int(stmt, index, limit);
 
-        car.setColor(colorTxt ? reinterpret_cast<const char*>(colorTxt) : "");
-        car.setVin(vinTxt ? reinterpret_cast<const char*>(vinTxt) : "");
-        car.setImageDataUrl(imgTxt ? reinterpret_cast<const char*>(imgTxt) : "");
-        car.setCreatedAt(createdTxt ? reinterpret_cast<const char*>(createdTxt) : "");
-        car.setUpdatedAt(updatedTxt ? reinterpret_cast<const char*>(updatedTxt) : "");
+    // One Car is reused for every row; nothing accumulates per row here
+    Car car;
+    int result;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        readCar(stmt, fields, car);
+        visit(car);
     }
 
-    sqlite3_finalize(stmt);
-    return car;
+    return result == SQLITE_DONE;
 }
 
-// Get all
-std::vector<Car> Database::getAllCars() {
-    std::vector<Car> cars;
+// One statement for any number of ids: they are bound as a single JSON array
+// and each is looked up through the primary key
+bool Database::getCarsByIds(const std::vector<int>& ids, std::vector<Car>& cars, uint32_t fields) {
+    if (ids.empty()) return true;
+
+    if (replicated) {
+        auto snapshot = replica.snapshot();
+        for (int id : ids) {
+            if (const Car* car = snapshot->find(id)) cars.push_back(*car);
+        }
+        return true;
+    }
 
-    std::string sql =
-        "SELECT id, make, model, year, price, mileage_km, color, vin, image_data_url, created_at, updated_at "
-        "FROM cars ORDER BY id;";
+    std::string list = "[";
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i) list += ',';
+        list += std::to_string(ids[i]);
+    }
+    list += ']';
 
-    sqlite3_stmt* stmt = nullptr;
-    int result = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
 
-    if (result != SQLITE_OK) return cars;
+    CachedStatement stmt = conn.prepare(selectCars(fields, "AND id IN (SELECT value FROM json_each(?));"));
+    if (!stmt) return false;
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Car car;
+    sqlite3_bind_text(stmt, 1, list.c_str(), static_cast<int>(list.size()), SQLITE_TRANSIENT);
 
-        car.setCarId(sqlite3_column_int(stmt, 0));
+    cars.reserve(cars.size() + ids.size());
+    int result;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        cars.push_back(readCar(stmt, fields));
+    }
+
+    return result == SQLITE_DONE;
+}
 
-        const unsigned char* makeTxt = sqlite3_column_text(stmt, 1);
-        const unsigned char* modelTxt = sqlite3_column_text(stmt, 2);
-        car.setMake(makeTxt ? reinterpret_cast<const char*>(makeTxt) : "");
-        car.setModel(modelTxt ? reinterpret_cast<const char*>(modelTxt) : "");
+// Tombstones sort in with the live rows; the extra column tells them apart.
+// idx_cars_change_seq turns this into a range scan over the recent writes only.
+bool Database::getChangesSince(uint64_t since, std::vector<Car>& changed, std::vector<int>& deleted) {
+    static const std::string sql = "SELECT " + CarFields::columns(CarFields::All) +
+        ", deleted_at IS NOT NULL FROM cars WHERE change_seq > ? ORDER BY change_seq;";
 
-        car.setYear(sqlite3_column_int(stmt, 3));
-        car.setPrice(sqlite3_column_double(stmt, 4));
-        car.setMileage(sqlite3_column_int(stmt, 5));
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
 
-        const unsigned char* colorTxt = sqlite3_column_text(stmt, 6);
-        const unsigned char* vinTxt = sqlite3_column_text(stmt, 7);
-        const unsigned char* imgTxt = sqlite3_column_text(stmt, 8);
-        const unsigned char* createdTxt = sqlite3_column_text(stmt, 9);
-        const unsigned char* updatedTxt = sqlite3_column_text(stmt, 10);
+    CachedStatement stmt = conn.prepare(sql);
+    if (!stmt) return false;
 
-        car.setColor(colorTxt ? reinterpret_cast<const char*>(colorTxt) : "");
-        car.setVin(vinTxt ? reinterpret_cast<const char*>(vinTxt) : "");
-        car.setImageDataUrl(imgTxt ? reinterpret_cast<const char*>(imgTxt) : "");
-        car.setCreatedAt(createdTxt ? reinterpret_cast<const char*>(createdTxt) : "");
-        car.setUpdatedAt(updatedTxt ? reinterpret_cast<const char*>(updatedTxt) : "");
+    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(since));
 
-        cars.push_back(car);
+    int result;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (sqlite3_column_int(stmt, static_cast<int>(CarFields::Count))) {
+            deleted.push_back(sqlite3_column_int(stmt, 0));
+        } else {
+            changed.push_back(readCar(stmt, CarFields::All));
+        }
     }
 
-    sqlite3_finalize(stmt);
-    return cars;
+    return result == SQLITE_DONE;
+}
+
+bool Database::getCarImageInfo(int id, ImageInfo& info) {
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
+
+    return ImageStore::findForCar(conn, id, info);
+}
+
+bool Database::readImage(const ImageInfo& info, int64_t offset, int64_t length, std::string& bytes) {
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
+
+    return ImageStore::read(conn, info, offset, length, bytes);
 }
 
 bool Database::carExists(int id) {
-    std::string sql = "SELECT COUNT(*) FROM cars WHERE id = ?;";
-    sqlite3_stmt* stmt = nullptr;
+    if (replicated) return replica.snapshot()->find(id) != nullptr;
+
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
 
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) return false;
+    static const std::string sql = "SELECT COUNT(*) FROM cars WHERE id = ? AND deleted_at IS NULL;";
+    CachedStatement stmt = conn.prepare(sql);
+    if (!stmt) return false;
 
     sqlite3_bind_int(stmt, 1, id);
 
@@ -271,17 +762,18 @@ bool Database::carExists(int id) {
         exists = sqlite3_column_int(stmt, 0) > 0;
     }
 
-    sqlite3_finalize(stmt);
     return exists;
 }
 
 bool Database::vinExists(const std::string& vin) {
     if (vin.empty()) return false;
 
-    std::string sql = "SELECT COUNT(*) FROM cars WHERE vin = ?;";
-    sqlite3_stmt* stmt = nullptr;
+    auto conn = pool.acquireReader();
+    if (!conn) return false;
 
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) return false;
+    static const std::string sql = "SELECT COUNT(*) FROM cars WHERE vin = ?;";
+    CachedStatement stmt = conn.prepare(sql);
+    if (!stmt) return false;
 
     sqlite3_bind_text(stmt, 1, vin.c_str(), -1, SQLITE_TRANSIENT);
 
@@ -290,11 +782,30 @@ bool Database::vinExists(const std::string& vin) {
         exists = sqlite3_column_int(stmt, 0) > 0;
     }
 
+    return exists;
+}
+
+bool Database::columnExists(const std::string& table, const std::string& column) {
+    auto conn = pool.acquireWriter();
+    if (!conn) return false;
+
+    sqlite3_stmt* stmt = nullptr;
+    std::string sql = "SELECT 1 FROM pragma_table_info(?) WHERE name = ?;";
+    if (sqlite3_prepare_v2(conn.get(), sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) return false;
+
+    sqlite3_bind_text(stmt, 1, table.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, column.c_str(), -1, SQLITE_TRANSIENT);
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+
     sqlite3_finalize(stmt);
     return exists;
 }
 
 bool Database::executeSQL(const std::string& sql) {
+    auto conn = pool.acquireWriter();
+    sqlite3* db = conn.get();
+    if (!db) return false;
+
     char* errorMessage = nullptr;
     int result = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errorMessage);
 
@@ -307,9 +818,115 @@ bool Database::executeSQL(const std::string& sql) {
     return true;
 }
 
+void Database::addChangeListener(CarChangeListener listener) {
+    listeners.push_back(std::move(listener));
+}
+
+// Runs on the writer thread after each committed batch, with the batch's
+// changes in commit order. The replica swaps first so that nothing
+// invalidated below can be refilled from the previous snapshot.
+void Database::publish(const std::vector<CarChange>& changes) {
+    if (replicated) replica.apply(changes);
+
+    for (const CarChange& change : changes) {
+        fragments.invalidate(change.id);
+        facetIndex.apply(change);
+    }
+
+    // After the caches, so a reader that sees the new version also sees the new data
+    if (!changes.empty()) version.store(changes.back().seq, std::memory_order_release);
+
+    // Listeners go last and one at a time: the batch is committed and the
+    // state above is already current, so a throwing listener only loses its
+    // own notification
+    for (const CarChange& change : changes) {
+        for (const auto& listener : listeners) {
+            try {
+                listener(change);
+            } catch (const std::exception& e) {
+                std::cerr << "Change listener threw: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Change listener threw" << std::endl;
+            }
+        }
+    }
+}
+
+// Purges once at startup and then every PurgeInterval until close()
+void Database::runPurger() {
+    std::unique_lock<std::mutex> lock(purgeMutex);
+    while (!purgeStopping) {
+        lock.unlock();
+        purgeTombstones();
+        lock.lock();
+        purgeWake.wait_for(lock, PurgeInterval, [this] { return purgeStopping; });
+    }
+}
+
+// Drops tombstones older than TombstoneRetention through the write queue, and
+// records the highest sequence dropped so stale delta requests can be refused
+void Database::purgeTombstones() {
+    std::string cutoff = formatTimestamp(time(0) -
+        std::chrono::duration_cast<std::chrono::seconds>(TombstoneRetention).count());
+    uint64_t through = 0;
+    int purged = 0;
+
+    int code = writes.submit([&](const ConnectionPool::Lease& conn) {
+        sqlite3* db = conn.get();
+        {
+            static const std::string sql =
+                "SELECT COUNT(*), MAX(change_seq) FROM cars WHERE deleted_at IS NOT NULL AND deleted_at < ?;";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) return sqlite3_errcode(db);
+
+            sqlite3_bind_text(stmt, 1, cutoff.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) != SQLITE_ROW) return sqlite3_extended_errcode(db);
+            purged = sqlite3_column_int(stmt, 0);
+            through = static_cast<uint64_t>(sqlite3_column_int64(stmt, 1));
+        }
+        if (purged == 0) return SQLITE_OK;
+
+        {
+            static const std::string sql = "DELETE FROM cars WHERE deleted_at IS NOT NULL AND deleted_at < ?;";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) return sqlite3_errcode(db);
+
+            sqlite3_bind_text(stmt, 1, cutoff.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) != SQLITE_DONE) return sqlite3_extended_errcode(db);
+        }
+
+        static const std::string sql =
+            "INSERT INTO sync_state (name, value) VALUES ('purged_through', ?) "
+            "ON CONFLICT(name) DO UPDATE SET value = max(value, excluded.value);";
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) return sqlite3_errcode(db);
+
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(through));
+        return sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_extended_errcode(db);
+    }, [&]() {
+        if (through > historyStart()) purgedThrough.store(through, std::memory_order_release);
+    });
+
+    if (code != SQLITE_OK) {
+        std::cerr << "Failed to purge deleted cars (SQLite error " << code << ")" << std::endl;
+    } else if (purged > 0) {
+        std::cout << "Purged " << purged << " deleted car(s)" << std::endl;
+    }
+}
+
 void Database::close() {
-    if (db) {
-        sqlite3_close(db);
-        db = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(purgeMutex);
+        purgeStopping = true;
     }
+    purgeWake.notify_all();
+    if (purger.joinable()) purger.join();
+
+    // Finish queued requests while their writes can still commit
+    tasks.stop();
+
+    // Let queued writes commit before the connections go away
+    writes.stop();
+    feed.stop();
+    pool.close();
 }
@@ -1,34 +1,179 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sqlite3.h>
+#include "connection_pool.h"
+#include "write_queue.h"
+#include "image_store.h"
+#include "car_fields.h"
+#include "car_query.h"
+#include "car_change.h"
+#include "facet_index.h"
+#include "fragment_cache.h"
+#include "car_replica.h"
+#include "change_feed.h"
+#include "db_executor.h"
 #include "../../Models/Car.h"
 
+// Outcome of a queued write; Conflict means a constraint (e.g. duplicate VIN) rejected it,
+// Invalid that the image was not a base64 PNG/JPEG/GIF/WebP data URL, NotFound that there was no live car to update
+enum class WriteResult { Ok, Conflict, Invalid, NotFound, Failed };
+
+// Outcome of one row of a bulk insert; id is set when result is Ok
+struct BatchRow {
+    WriteResult result;
+    int id;
+};
+
 class Database {
 public:
-    // Constructor and Destructor
-    Database(const std::string& dbPath);
+    static constexpr size_t DefaultJsonCacheBytes = 32 * 1024 * 1024;
+
+    // Rows per transaction chunk of insertCars
+    static constexpr size_t BatchChunkRows = 500;
+
+    // Deleted cars stay behind as tombstones this long, so delta sync clients
+    // can learn about the delete; the purge runs this often
+    static constexpr std::chrono::hours TombstoneRetention{24 * 7};
+    static constexpr std::chrono::hours PurgeInterval{1};
+
+    // Constructor and Destructor (readerCount of 0 sizes the read pool to the hardware threads).
+    // With inMemoryReads, car reads are answered from an in-memory replica
+    // instead of SQLite; see CarReplica.
+    Database(const std::string& dbPath, size_t readerCount = 0, size_t jsonCacheBytes = DefaultJsonCacheBytes,
+             bool inMemoryReads = true);
     ~Database();
 
     // Initialize the  database and create the tables...well a single table so far
     bool initialize();
 
-    // CRUD Operations
-    bool insertCar(const Car& car, int& newId);
-    bool updateCar(int id, const Car& car);
+    // CRUD Operations (writes go through the group-commit queue and block until durable).
+    // insertCar and updateCar hand back the row as stored, read by the write
+    // itself (RETURNING), so callers don't look it up again.
+    WriteResult insertCar(const Car& car, Car& created);
+    // Inserts cars in chunks of BatchChunkRows, each its own write; a row that
+    // fails (e.g. a duplicate VIN) is skipped without affecting the others.
+    // results[i] is the outcome for cars[i].
+    void insertCars(const std::vector<Car>& cars, std::vector<BatchRow>& results);
+    // Sets the columns in columns (a CarFields mask) from car, in one UPDATE;
+    // the rest keep their values. Without the Image bit the stored image is
+    // untouched; with it, an empty imageDataUrl removes it.
+    WriteResult updateCar(int id, const Car& car, uint32_t columns, Car& updated);
+    // Soft delete: the row becomes a tombstone (its VIN freed, its image
+    // released) until purged after TombstoneRetention
     bool deleteCar(int id);
-    Car getCarById(int id, bool& found);
-    std::vector<Car> getAllCars();
+
+    // Reads select only the columns in fields (a CarFields mask); id is always
+    // read. Served from the replica, they return whole rows.
+    Car getCarById(int id, bool& found, uint32_t fields = CarFields::All);
+    std::vector<Car> getAllCars(uint32_t fields = CarFields::All);
+
+    // Filtered, sorted listing; up to limit rows (all when limit <= 0), resuming
+    // after query's keyset position. The sort key's field is always read, for cursors.
+    std::vector<Car> findCars(const CarQuery& query, int limit, uint32_t fields = CarFields::All);
+
+    // Same rows as findCars, handed to visit one at a time straight off the
+    // cursor (the Car is reused between calls). False if the query failed.
+    bool forEachCar(const CarQuery& query, int limit, uint32_t fields, const std::function<void(const Car&)>& visit);
+
+    // Every car in id order, read off one SQLite cursor even when the replica
+    // serves other reads. The SELECT sees a single snapshot, so writes that
+    // commit meanwhile are left out. Memory use doesn't grow with the table;
+    // the Car is reused between calls. False if the query failed.
+    bool scanCars(uint32_t fields, const std::function<void(const Car&)>& visit);
+
+    // Appends the cars among ids that exist, in no particular order. False if the query failed.
+    bool getCarsByIds(const std::vector<int>& ids, std::vector<Car>& cars, uint32_t fields = CarFields::All);
+
+    // Images are stored apart from the cars row, once per distinct content hash.
+    // getCarImageInfo is false if the car has none; readImage reads a byte range.
+    bool getCarImageInfo(int id, ImageInfo& info);
+    bool readImage(const ImageInfo& info, int64_t offset, int64_t length, std::string& bytes);
+
+    // Change sequence of the latest published write. Every insert, update and
+    // delete stamps its row with the next sequence, so this grows with each
+    // committed batch and never repeats, even across restarts. Read it before
+    // reading the data it describes.
+    uint64_t dataVersion() const { return version.load(std::memory_order_acquire); }
+
+    // Rows written after version since, in change order: live cars in changed,
+    // tombstones' ids in deleted. Only complete while since >= historyStart().
+    bool getChangesSince(uint64_t since, std::vector<Car>& changed, std::vector<int>& deleted);
+
+    // Highest sequence among purged tombstones; deltas from before it would
+    // miss deletes
+    uint64_t historyStart() const { return purgedThrough.load(std::memory_order_acquire); }
+
+    // Serialized JSON per car, dropped whenever that car is written
+    FragmentCache& jsonCache() { return fragments; }
+
+    // Make/model/color/year counts, maintained in memory as writes commit
+    Facets facets() const { return facetIndex.snapshot(); }
+
+    // Push subscribers of the change stream; running between initialize() and close()
+    ChangeFeed& changeFeed() { return feed; }
+
+    // Threads that route handlers hand their database work to; running
+    // between initialize() and close()
+    DbExecutor& executor() { return tasks; }
+
+    // Called after every committed insert, update and delete, on the writer
+    // thread and in commit order, so keep listeners short. One that throws is
+    // logged and the others still run. Register them before the server
+    // starts taking requests.
+    void addChangeListener(CarChangeListener listener);
 
     // Utility methods
     bool carExists(int id);
     bool vinExists(const std::string& vin);
     void close();
 
+    // Prepared-statement cache counters across all pooled connections
+    uint64_t statementCacheHits() const { return pool.statementCacheHits(); }
+    uint64_t statementCacheMisses() const { return pool.statementCacheMisses(); }
+    uint64_t statementCacheEvictions() const { return pool.statementCacheEvictions(); }
+
+    // Group-commit counters
+    const WriteQueue& writeQueue() const { return writes; }
+
 private:
-    sqlite3* db;
     std::string dbPath;
-    
+    ConnectionPool pool;
+    WriteQueue writes;
+    FacetIndex facetIndex;
+    FragmentCache fragments;
+    CarReplica replica;
+    ChangeFeed feed;
+    DbExecutor tasks;
+    bool inMemoryReads;
+    bool replicated = false;
+    std::atomic<uint64_t> version{0};
+    std::atomic<uint64_t> purgedThrough{0};
+    std::vector<CarChangeListener> listeners;
+
+    // Last change sequence handed out; only touched on the writer thread
+    uint64_t lastSeq = 0;
+
+    std::thread purger;
+    std::mutex purgeMutex;
+    std::condition_variable purgeWake;
+    bool purgeStopping = false;
+
+    // Filled by commit callbacks on the writer thread, published once per batch
+    std::vector<CarChange> committedChanges;
+
+    void publish(const std::vector<CarChange>& changes);
+    bool queryCars(const CarQuery& query, int limit, uint32_t fields, const std::function<void(const Car&)>& visit);
+    void runPurger();
+    void purgeTombstones();
+
     // Helper function to run SQL
     bool executeSQL(const std::string& sql);
+    bool columnExists(const std::string& table, const std::string& column);
 };
\ No newline at end of file
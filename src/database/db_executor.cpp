@@ -0,0 +1,85 @@
+#include "db_executor.h"
+#include <algorithm>
+#include <iostream>
+
+DbExecutor::DbExecutor(size_t capacity) : maxQueued(capacity ? capacity : 1) {}
+
+DbExecutor::~DbExecutor() { stop(); }
+
+void DbExecutor::start(size_t threads) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency()) * 2;
+
+    running = true;
+    stopping = false;
+    for (size_t i = 0; i < threads; i++) workers.emplace_back(&DbExecutor::run, this);
+}
+
+void DbExecutor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        stopping = true;
+    }
+    hasWork.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    workers.clear();
+    running = false;
+}
+
+bool DbExecutor::submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || stopping || queue.size() >= maxQueued) {
+            rejectedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        queue.push_back(Queued{std::move(task), std::chrono::steady_clock::now()});
+    }
+    hasWork.notify_one();
+    return true;
+}
+
+size_t DbExecutor::depth() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+void DbExecutor::run() {
+    while (true) {
+        Queued next;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            hasWork.wait(lock, [this] { return stopping || !queue.empty(); });
+
+            if (queue.empty()) return; // stopping and fully drained
+
+            next = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        uint64_t waited = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - next.enqueued).count();
+        waitTotal.fetch_add(waited, std::memory_order_relaxed);
+
+        uint64_t longest = waitMax.load(std::memory_order_relaxed);
+        while (waited > longest && !waitMax.compare_exchange_weak(longest, waited, std::memory_order_relaxed)) {}
+
+        // A throwing task must not take the thread (and the process) with it
+        try {
+            next.task();
+        } catch (const std::exception& e) {
+            std::cerr << "Executor task threw: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Executor task threw" << std::endl;
+        }
+        executedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
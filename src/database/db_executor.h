@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool for database work, so HTTP worker threads only parse requests
+// and write responses. Route handlers submit a task and return; the task
+// runs here, reads or writes, and completes the response. The queue is
+// bounded: when it is full submit() refuses the task and the caller sheds
+// the request instead of letting waits grow without limit. Sized apart from
+// the HTTP threads, so socket handling and database work scale separately.
+class DbExecutor {
+public:
+    static constexpr size_t DefaultCapacity = 1024;
+
+    using Task = std::function<void()>;
+
+    explicit DbExecutor(size_t capacity = DefaultCapacity);
+    ~DbExecutor();
+
+    DbExecutor(const DbExecutor&) = delete;
+    DbExecutor& operator=(const DbExecutor&) = delete;
+
+    // threads of 0 uses twice the hardware threads
+    void start(size_t threads);
+    // Runs what is already queued, then stops the threads
+    void stop();
+
+    // False when the queue is full or the executor isn't running; the task
+    // is not run then
+    bool submit(Task task);
+
+    size_t threads() const { return workers.size(); }
+    size_t capacity() const { return maxQueued; }
+    size_t depth() const;
+    uint64_t executed() const { return executedCount.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return rejectedCount.load(std::memory_order_relaxed); }
+
+    // Time tasks spent queued before a thread picked them up
+    uint64_t totalWaitMicros() const { return waitTotal.load(std::memory_order_relaxed); }
+    uint64_t maxWaitMicros() const { return waitMax.load(std::memory_order_relaxed); }
+
+private:
+    struct Queued {
+        Task task;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    size_t maxQueued;
+
+    mutable std::mutex mutex;
+    std::condition_variable hasWork;
+    std::deque<Queued> queue;
+    bool running = false;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    std::atomic<uint64_t> executedCount{0};
+    std::atomic<uint64_t> rejectedCount{0};
+    std::atomic<uint64_t> waitTotal{0};
+    std::atomic<uint64_t> waitMax{0};
+
+    void run();
+};
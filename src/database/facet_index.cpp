@@ -0,0 +1,58 @@
+#include "facet_index.h"
+#include <iostream>
+
+template <typename Map, typename Key>
+static void bump(Map& counts, const Key& key, long delta) {
+    long& count = counts[key];
+    count += delta;
+    if (count == 0) counts.erase(key);
+}
+
+bool FacetIndex::load(const ConnectionPool::Lease& conn) {
+    static const std::string sql =
+        "SELECT make, model, color, year, COUNT(*) FROM cars WHERE deleted_at IS NULL GROUP BY make, model, color, year;";
+    CachedStatement stmt = conn.prepare(sql);
+    if (!stmt) {
+        std::cerr << "Failed to load facets: " << sqlite3_errmsg(conn.get()) << std::endl;
+        return false;
+    }
+
+    Facets loaded;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto text = [&](int column) -> std::string {
+            const unsigned char* value = sqlite3_column_text(stmt, column);
+            return value ? reinterpret_cast<const char*>(value) : "";
+        };
+
+        std::string make = text(0);
+        std::string color = text(2);
+        long count = sqlite3_column_int64(stmt, 4);
+
+        bump(loaded.makes, make, count);
+        bump(loaded.models, std::make_pair(make, text(1)), count);
+        if (!color.empty()) bump(loaded.colors, color, count);
+        bump(loaded.years, sqlite3_column_int(stmt, 3), count);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    facets = std::move(loaded);
+    return true;
+}
+
+void FacetIndex::apply(const CarChange& change) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (change.kind != CarChange::Kind::Inserted) adjust(change.before, -1);
+    if (change.kind != CarChange::Kind::Deleted) adjust(change.after, +1);
+}
+
+void FacetIndex::adjust(const Car& car, long delta) {
+    bump(facets.makes, car.getMake(), delta);
+    bump(facets.models, std::make_pair(car.getMake(), car.getModel()), delta);
+    if (!car.getColor().empty()) bump(facets.colors, car.getColor(), delta);
+    bump(facets.years, car.getYear(), delta);
+}
+
+Facets FacetIndex::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return facets;
+}
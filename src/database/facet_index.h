@@ -0,0 +1,35 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include "car_change.h"
+#include "connection_pool.h"
+
+// Distinct values and counts for the listing's filter dropdowns
+struct Facets {
+    std::map<std::string, long> makes;
+    std::map<std::pair<std::string, std::string>, long> models;   // (make, model)
+    std::map<std::string, long> colors;
+    std::map<int, long> years;
+};
+
+// Facet counts kept in memory. Loaded with one grouped query at startup and
+// then maintained from CarChange deltas, so reading them never touches the
+// table and costs O(distinct values).
+class FacetIndex {
+public:
+    bool load(const ConnectionPool::Lease& conn);
+
+    void apply(const CarChange& change);
+
+    // Copy of the current counts; values whose count dropped to zero are gone
+    Facets snapshot() const;
+
+private:
+    mutable std::mutex mutex;
+    Facets facets;
+
+    // A count is erased as soon as it reaches zero
+    void adjust(const Car& car, long delta);
+};
@@ -0,0 +1,91 @@
+#include "fragment_cache.h"
+
+// Per-entry bookkeeping (list node, map node, shared_ptr control block)
+static const size_t EntryOverhead = 96;
+
+static size_t costOf(const FragmentCache::Fragment& fragment) {
+    return fragment->size() + EntryOverhead;
+}
+
+FragmentCache::FragmentCache(size_t byteBudget, size_t shardCount) {
+    if (shardCount == 0) shardCount = 1;
+    shardBudget = byteBudget / shardCount;
+
+    shards.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; i++) shards.push_back(std::make_unique<Shard>());
+}
+
+FragmentCache::Fragment FragmentCache::get(int id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.index.find(id);
+    if (found == shard.index.end()) {
+        missCount.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    hitCount.fetch_add(1, std::memory_order_relaxed);
+    return found->second->fragment;
+}
+
+uint64_t FragmentCache::version(int id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.version;
+}
+
+void FragmentCache::put(int id, Fragment fragment, uint64_t version) {
+    size_t cost = costOf(fragment);
+    if (cost > shardBudget) return;
+
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.version != version) return;
+
+    auto found = shard.index.find(id);
+    if (found != shard.index.end()) erase(shard, found->second);
+
+    shard.lru.push_front(Entry{id, std::move(fragment)});
+    shard.index[id] = shard.lru.begin();
+    shard.bytes += cost;
+
+    while (shard.bytes > shardBudget) {
+        erase(shard, std::prev(shard.lru.end()));
+        evictionCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FragmentCache::invalidate(int id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    shard.version++;
+    auto found = shard.index.find(id);
+    if (found != shard.index.end()) erase(shard, found->second);
+}
+
+void FragmentCache::erase(Shard& shard, std::list<Entry>::iterator entry) {
+    shard.bytes -= costOf(entry->fragment);
+    shard.index.erase(entry->id);
+    shard.lru.erase(entry);
+}
+
+size_t FragmentCache::bytes() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->bytes;
+    }
+    return total;
+}
+
+size_t FragmentCache::entries() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->index.size();
+    }
+    return total;
+}
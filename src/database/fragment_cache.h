@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Byte-bounded LRU cache of each car's serialized JSON, split into shards
+// so concurrent readers mostly take different locks. Each shard keeps a
+// version that every invalidation bumps; a fragment built from a read that
+// started before an invalidation is refused, so a racing writer can never
+// leave a stale fragment behind.
+class FragmentCache {
+public:
+    using Fragment = std::shared_ptr<const std::string>;
+
+    // byteBudget is split evenly across the shards
+    explicit FragmentCache(size_t byteBudget, size_t shardCount = 16);
+
+    FragmentCache(const FragmentCache&) = delete;
+    FragmentCache& operator=(const FragmentCache&) = delete;
+
+    // nullptr on a miss
+    Fragment get(int id);
+
+    // Take before reading the row a fragment will be built from
+    uint64_t version(int id);
+
+    // Stores the fragment unless id's shard was invalidated after version was taken
+    void put(int id, Fragment fragment, uint64_t version);
+
+    void invalidate(int id);
+
+    uint64_t hits() const { return hitCount.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return missCount.load(std::memory_order_relaxed); }
+    uint64_t evictions() const { return evictionCount.load(std::memory_order_relaxed); }
+    size_t bytes() const;
+    size_t entries() const;
+
+private:
+    struct Entry {
+        int id;
+        Fragment fragment;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;   // most recently used first
+        std::unordered_map<int, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        uint64_t version = 0;
+    };
+
+    size_t shardBudget;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> missCount{0};
+    std::atomic<uint64_t> evictionCount{0};
+
+    Shard& shardFor(int id) { return *shards[static_cast<unsigned>(id) % shards.size()]; }
+    void erase(Shard& shard, std::list<Entry>::iterator entry);
+};
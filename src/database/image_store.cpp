@@ -0,0 +1,198 @@
+#include "image_store.h"
+#include "DataUrl.h"
+#include "Sha1.h"
+#include <cctype>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+static int stepDone(const ConnectionPool::Lease& conn, sqlite3_stmt* stmt, const char* what) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "Failed to " << what << ": " << sqlite3_errmsg(conn.get()) << std::endl;
+        return sqlite3_extended_errcode(conn.get());
+    }
+    return SQLITE_OK;
+}
+
+bool ImageStore::allowedType(const std::string& mimeType) {
+    static const char* const types[] = {"image/png", "image/jpeg", "image/gif", "image/webp"};
+    for (const char* type : types) {
+        if (mimeType == type) return true;
+    }
+    return false;
+}
+
+bool ImageStore::decode(const std::string& dataUrl, ImageUpload& upload) {
+    if (!DataUrl::decode(dataUrl, upload.mimeType, upload.bytes)) return false;
+    if (upload.bytes.empty()) return false;
+
+    // The type is served back as Content-Type from our own origin, so only
+    // plain raster images get in (no text/html, no image/svg+xml)
+    for (char& c : upload.mimeType) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (!allowedType(upload.mimeType)) return false;
+
+    upload.hash = Sha1::hex(upload.bytes);
+    return true;
+}
+
+int ImageStore::attach(const ConnectionPool::Lease& conn, int carId, const ImageUpload* upload) {
+    std::string previousHash;
+    {
+        static const std::string sql = "SELECT image_hash FROM cars WHERE id = ?;";
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) return sqlite3_errcode(conn.get());
+
+        sqlite3_bind_int(stmt, 1, carId);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            previousHash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+    }
+
+    if (upload) {
+        // Identical bytes are stored once, whichever car uploaded them first
+        static const std::string sql =
+            "INSERT INTO images (hash, mime_type, data) VALUES (?, ?, ?) ON CONFLICT(hash) DO NOTHING;";
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) return sqlite3_errcode(conn.get());
+
+        sqlite3_bind_text(stmt, 1, upload->hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, upload->mimeType.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_blob64(stmt, 3, upload->bytes.data(), upload->bytes.size(), SQLITE_STATIC);
+
+        int result = stepDone(conn, stmt, "store image");
+        if (result != SQLITE_OK) return result;
+    }
+
+    {
+        static const std::string sql = "UPDATE cars SET image_hash = ? WHERE id = ?;";
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) return sqlite3_errcode(conn.get());
+
+        if (upload) sqlite3_bind_text(stmt, 1, upload->hash.c_str(), -1, SQLITE_STATIC);
+        else sqlite3_bind_null(stmt, 1);
+        sqlite3_bind_int(stmt, 2, carId);
+
+        int result = stepDone(conn, stmt, "link car image");
+        if (result != SQLITE_OK) return result;
+    }
+
+    if (!previousHash.empty() && (!upload || upload->hash != previousHash)) {
+        static const std::string sql =
+            "DELETE FROM images WHERE hash = ?1 AND NOT EXISTS (SELECT 1 FROM cars WHERE image_hash = ?1);";
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) return sqlite3_errcode(conn.get());
+
+        sqlite3_bind_text(stmt, 1, previousHash.c_str(), -1, SQLITE_STATIC);
+        return stepDone(conn, stmt, "release unused image");
+    }
+
+    return SQLITE_OK;
+}
+
+bool ImageStore::findForCar(const ConnectionPool::Lease& conn, int carId, ImageInfo& info) {
+    // length() of a BLOB comes from the record header, so this never touches the image pages
+    static const std::string sql =
+        "SELECT images.hash, images.mime_type, length(images.data) "
+        "FROM cars JOIN images ON images.hash = cars.image_hash WHERE cars.id = ?;";
+    CachedStatement stmt = conn.prepare(sql);
+    if (!stmt) return false;
+
+    sqlite3_bind_int(stmt, 1, carId);
+    if (sqlite3_step(stmt) != SQLITE_ROW) return false;
+
+    info.hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    info.mimeType = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    info.size = sqlite3_column_int64(stmt, 2);
+    return true;
+}
+
+bool ImageStore::read(const ConnectionPool::Lease& conn, const ImageInfo& info, int64_t offset, int64_t length, std::string& out) {
+    if (offset < 0 || length < 0 || offset + length > info.size) return false;
+
+    // The rowid is looked up and the blob read in one snapshot: once the image
+    // is released its rowid can be reused by another, whose bytes must not go
+    // out under this hash
+    if (sqlite3_exec(conn.get(), "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) return false;
+
+    bool ok = false;
+    {
+        static const std::string sql = "SELECT rowid, length(data) FROM images WHERE hash = ?;";
+        CachedStatement stmt = conn.prepare(sql);
+        sqlite3_blob* blob = nullptr;
+
+        if (stmt) sqlite3_bind_text(stmt, 1, info.hash.c_str(), -1, SQLITE_STATIC);
+        if (stmt && sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 1) == info.size &&
+            sqlite3_blob_open(conn.get(), "main", "images", "data", sqlite3_column_int64(stmt, 0), 0, &blob) == SQLITE_OK) {
+            out.resize(static_cast<size_t>(length));
+            ok = length == 0 ||
+                 sqlite3_blob_read(blob, &out[0], static_cast<int>(length), static_cast<int>(offset)) == SQLITE_OK;
+        }
+        sqlite3_blob_close(blob);
+    }
+
+    sqlite3_exec(conn.get(), "COMMIT;", nullptr, nullptr, nullptr);
+    return ok;
+}
+
+bool ImageStore::migrateLegacy(const ConnectionPool::Lease& conn) {
+    sqlite3* db = conn.get();
+
+    // Collect first: the rows are rewritten while we go
+    std::vector<std::pair<int, std::string>> legacy;
+    {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db, "SELECT id, image_data_url FROM cars WHERE image_data_url IS NOT NULL;", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to read legacy images: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            legacy.emplace_back(sqlite3_column_int(stmt, 0), text ? text : "");
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (legacy.empty()) return true;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) return false;
+
+    // Only rows actually moved are cleared; anything undecodable stays in
+    // image_data_url so it can still be recovered by hand
+    size_t migrated = 0;
+    size_t kept = 0;
+    for (auto& entry : legacy) {
+        ImageUpload upload;
+        if (!decode(entry.second, upload)) {
+            std::cerr << "Leaving undecodable legacy image for car " << entry.first << " in place" << std::endl;
+            kept++;
+            continue;
+        }
+
+        int result = attach(conn, entry.first, &upload);
+        if (result == SQLITE_OK) {
+            static const std::string sql = "UPDATE cars SET image_data_url = NULL WHERE id = ?;";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
+                result = sqlite3_errcode(db);
+            } else {
+                sqlite3_bind_int(stmt, 1, entry.first);
+                result = stepDone(conn, stmt, "clear legacy image");
+            }
+        }
+        if (result != SQLITE_OK) {
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            return false;
+        }
+        migrated++;
+    }
+
+    if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to finish image migration: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+
+    if (migrated > 0) std::cout << "Migrated " << migrated << " legacy image(s) into the image store" << std::endl;
+    if (kept > 0) std::cerr << kept << " legacy image(s) could not be decoded and were left in cars.image_data_url" << std::endl;
+    return true;
+}
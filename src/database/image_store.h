@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "connection_pool.h"
+
+// A decoded upload, ready to be stored under its content hash
+struct ImageUpload {
+    std::string hash;     // lowercase hex SHA-1 of bytes
+    std::string mimeType;
+    std::string bytes;
+};
+
+// What a reader needs to serve an image without loading it yet
+struct ImageInfo {
+    std::string hash;
+    std::string mimeType;
+    int64_t size = 0;
+};
+
+// Content-addressed image storage. Decoded bytes live once per distinct
+// SHA-1 in the images table; cars point at them through cars.image_hash.
+// Images no car references any more are deleted as part of the same write.
+class ImageStore {
+public:
+    // Decode a base64 data URL and hash the bytes. False unless it is a PNG,
+    // JPEG, GIF or WebP. Runs on the caller's thread so the writer thread
+    // only does I/O.
+    static bool decode(const std::string& dataUrl, ImageUpload& upload);
+
+    // Whether mimeType is one of the image types decode() accepts
+    static bool allowedType(const std::string& mimeType);
+
+    // Point carId at upload (nullptr clears it) and drop the previous image if
+    // it became unreferenced. Must run inside a queued mutation.
+    static int attach(const ConnectionPool::Lease& conn, int carId, const ImageUpload* upload);
+
+    static bool findForCar(const ConnectionPool::Lease& conn, int carId, ImageInfo& info);
+
+    // Read [offset, offset + length) of the image stored under info.hash
+    // straight from the blob pages. False if it is gone by now.
+    static bool read(const ConnectionPool::Lease& conn, const ImageInfo& info, int64_t offset, int64_t length, std::string& out);
+
+    // Move data URLs left in cars.image_data_url into the content-addressed store
+    static bool migrateLegacy(const ConnectionPool::Lease& conn);
+};
@@ -9,14 +9,37 @@ CREATE TABLE IF NOT EXISTS cars (
     mileage_km INTEGER NOT NULL,
     color TEXT,
     vin TEXT UNIQUE,
-    image_data_url TEXT,        
+    image_data_url TEXT,        -- legacy, migrated into images at startup
     created_at TEXT NOT NULL,
-    updated_at TEXT NOT NULL
+    updated_at TEXT NOT NULL,
+    image_hash TEXT REFERENCES images(hash),
+    change_seq INTEGER NOT NULL DEFAULT 1,  -- sequence of the row's latest write
+    deleted_at TEXT                         -- set on delete; the row stays as a tombstone until purged
+);
+
+-- Decoded image bytes, stored once per distinct SHA-1
+CREATE TABLE IF NOT EXISTS images (
+    hash TEXT PRIMARY KEY,
+    mime_type TEXT NOT NULL,
+    data BLOB NOT NULL
+);
+
+-- Delta sync bookkeeping, e.g. purged_through: highest sequence among purged tombstones
+CREATE TABLE IF NOT EXISTS sync_state (
+    name TEXT PRIMARY KEY,
+    value INTEGER NOT NULL
 );
 
 CREATE INDEX IF NOT EXISTS idx_cars_make_model ON cars(make, model);
 CREATE INDEX IF NOT EXISTS idx_cars_year ON cars(year);
+CREATE INDEX IF NOT EXISTS idx_cars_model ON cars(model);
+CREATE INDEX IF NOT EXISTS idx_cars_color ON cars(color);
+CREATE INDEX IF NOT EXISTS idx_cars_price ON cars(price);
+CREATE INDEX IF NOT EXISTS idx_cars_mileage ON cars(mileage_km);
 CREATE UNIQUE INDEX IF NOT EXISTS idx_cars_vin ON cars(vin) WHERE vin IS NOT NULL;
+CREATE INDEX IF NOT EXISTS idx_cars_image_hash ON cars(image_hash);
+CREATE INDEX IF NOT EXISTS idx_cars_change_seq ON cars(change_seq);
+CREATE INDEX IF NOT EXISTS idx_cars_deleted_at ON cars(deleted_at) WHERE deleted_at IS NOT NULL;
 
 -- sample data 
 INSERT OR IGNORE INTO cars (make, model, year, price, mileage_km, color, vin, image_data_url, created_at, updated_at)
@@ -0,0 +1,104 @@
+#include "statement_cache.h"
+#include <iostream>
+
+// CachedStatement
+
+CachedStatement::CachedStatement(sqlite3_stmt* stmt, bool* inUse) : stmt(stmt), inUse(inUse) {}
+
+CachedStatement::CachedStatement(CachedStatement&& other) noexcept
+    : stmt(other.stmt), inUse(other.inUse) {
+    other.stmt = nullptr;
+    other.inUse = nullptr;
+}
+
+CachedStatement& CachedStatement::operator=(CachedStatement&& other) noexcept {
+    if (this != &other) {
+        release();
+        stmt = other.stmt;
+        inUse = other.inUse;
+        other.stmt = nullptr;
+        other.inUse = nullptr;
+    }
+    return *this;
+}
+
+CachedStatement::~CachedStatement() { release(); }
+
+void CachedStatement::release() {
+    if (!stmt) return;
+
+    if (inUse) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        *inUse = false;
+    } else {
+        sqlite3_finalize(stmt);
+    }
+
+    stmt = nullptr;
+    inUse = nullptr;
+}
+
+// StatementCache
+
+StatementCache::StatementCache(sqlite3* db, Counters& counters, size_t capacity)
+    : db(db), counters(counters), capacity(capacity ? capacity : 1) {}
+
+StatementCache::~StatementCache() { clear(); }
+
+CachedStatement StatementCache::acquire(const std::string& sql) {
+    auto it = statements.find(sql);
+
+    if (it != statements.end()) {
+        if (!it->second.inUse) {
+            counters.hits.fetch_add(1, std::memory_order_relaxed);
+            recency.splice(recency.begin(), recency, it->second.position);
+            it->second.inUse = true;
+            return CachedStatement(it->second.stmt, &it->second.inUse);
+        }
+    }
+
+    counters.misses.fetch_add(1, std::memory_order_relaxed);
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v3(db, sql.c_str(), static_cast<int>(sql.size()), SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_finalize(stmt);
+        return CachedStatement();
+    }
+
+    // Already cached but borrowed further up the stack: hand out a one-off copy
+    if (it != statements.end()) return CachedStatement(stmt, nullptr);
+
+    if (statements.size() >= capacity) evictIdle();
+
+    auto inserted = statements.emplace(sql, Entry()).first;
+    Entry& entry = inserted->second;
+    entry.stmt = stmt;
+    entry.inUse = true;
+    recency.push_front(&inserted->first);
+    entry.position = recency.begin();
+    return CachedStatement(entry.stmt, &entry.inUse);
+}
+
+// Finalizes the least recently used statement nobody is borrowing. When all
+// are borrowed the cache briefly grows past capacity instead.
+void StatementCache::evictIdle() {
+    for (auto position = recency.end(); position != recency.begin();) {
+        --position;
+        auto it = statements.find(**position);
+        if (it->second.inUse) continue;
+
+        sqlite3_finalize(it->second.stmt);
+        recency.erase(position);
+        statements.erase(it);
+        counters.evictions.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+void StatementCache::clear() {
+    for (auto& kv : statements) sqlite3_finalize(kv.second.stmt);
+    statements.clear();
+    recency.clear();
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <sqlite3.h>
+
+// Prepared statement borrowed from a StatementCache. On destruction it is reset
+// and its bindings cleared so the next caller gets it ready to bind again.
+class CachedStatement {
+public:
+    CachedStatement() = default;
+    // inUse points at the cache entry's flag; nullptr means the statement is
+    // a one-off that bypassed the cache and is finalized instead of reset
+    CachedStatement(sqlite3_stmt* stmt, bool* inUse);
+    CachedStatement(CachedStatement&& other) noexcept;
+    CachedStatement& operator=(CachedStatement&& other) noexcept;
+    CachedStatement(const CachedStatement&) = delete;
+    CachedStatement& operator=(const CachedStatement&) = delete;
+    ~CachedStatement();
+
+    sqlite3_stmt* get() const { return stmt; }
+    operator sqlite3_stmt*() const { return stmt; }
+
+private:
+    sqlite3_stmt* stmt = nullptr;
+    bool* inUse = nullptr;
+
+    void release();
+};
+
+// Per-connection cache of prepared statements keyed by SQL text, holding at
+// most capacity of them: SQL varies with client input (projections, filters,
+// sort), so the least recently used idle statement is finalized to make room.
+// Not thread safe: it belongs to exactly one connection, which is only ever
+// used by the thread holding its lease.
+class StatementCache {
+public:
+    struct Counters {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    static constexpr size_t DefaultCapacity = 128;
+
+    StatementCache(sqlite3* db, Counters& counters, size_t capacity = DefaultCapacity);
+    ~StatementCache();
+
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    // Returns the cached statement for sql, preparing it on first use. If the
+    // cached copy is already borrowed (nested use on the same connection) a
+    // one-off statement is prepared instead. An empty CachedStatement means
+    // the SQL failed to prepare.
+    CachedStatement acquire(const std::string& sql);
+
+    // Finalize everything; must run before the connection is closed
+    void clear();
+
+private:
+    struct Entry {
+        sqlite3_stmt* stmt = nullptr;
+        bool inUse = false;
+        std::list<const std::string*>::iterator position;   // in recency
+    };
+
+    sqlite3* db;
+    Counters& counters;
+    size_t capacity;
+    std::unordered_map<std::string, Entry> statements;
+    // Keys of statements, most recently used first
+    std::list<const std::string*> recency;
+
+    void evictIdle();
+};
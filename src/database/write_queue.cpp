@@ -0,0 +1,147 @@
+#include "write_queue.h"
+#include <iostream>
+#include <vector>
+
+// Runs a post-commit callback; nothing it throws may reach the writer thread
+static void runCallback(const std::function<void()>& callback) {
+    try {
+        callback();
+    } catch (const std::exception& e) {
+        std::cerr << "Commit callback threw: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Commit callback threw" << std::endl;
+    }
+}
+
+WriteQueue::WriteQueue(ConnectionPool& pool, size_t maxBatch, std::chrono::microseconds window)
+    : pool(pool), maxBatch(maxBatch ? maxBatch : 1), window(window) {}
+
+WriteQueue::~WriteQueue() { stop(); }
+
+void WriteQueue::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+
+    running = true;
+    stopping = false;
+    writer = std::thread(&WriteQueue::run, this);
+}
+
+void WriteQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        stopping = true;
+    }
+    hasWork.notify_all();
+
+    // The writer drains whatever is still queued before it exits
+    if (writer.joinable()) writer.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+}
+
+int WriteQueue::submit(Mutation mutation, Committed committed) {
+    std::future<int> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || stopping) return SQLITE_MISUSE;
+
+        queue.push_back(Pending{std::move(mutation), std::move(committed), std::promise<int>()});
+        result = queue.back().result.get_future();
+    }
+    hasWork.notify_one();
+
+    return result.get();
+}
+
+void WriteQueue::run() {
+    std::vector<Pending> batch;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            hasWork.wait(lock, [this] { return stopping || !queue.empty(); });
+
+            if (queue.empty()) return; // stopping and fully drained
+
+            // Linger briefly so concurrent writers can join this commit
+            if (queue.size() < maxBatch && !stopping) {
+                hasWork.wait_for(lock, window, [this] { return stopping || queue.size() >= maxBatch; });
+            }
+
+            size_t count = std::min(queue.size(), maxBatch);
+            for (size_t i = 0; i < count; i++) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+
+        commitBatch(batch);
+        batch.clear();
+    }
+}
+
+void WriteQueue::commitBatch(std::vector<Pending>& batch) {
+    std::vector<int> results(batch.size(), SQLITE_OK);
+
+    auto failAll = [&](int code) {
+        for (auto& pending : batch) pending.result.set_value(code);
+    };
+
+    auto conn = pool.acquireWriter();
+    if (!conn) {
+        failAll(SQLITE_CANTOPEN);
+        return;
+    }
+
+    int result = conn.execute("BEGIN IMMEDIATE;");
+    if (result != SQLITE_OK) {
+        std::cerr << "Failed to begin write batch: " << sqlite3_errmsg(conn.get()) << std::endl;
+        failAll(result);
+        return;
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        conn.execute("SAVEPOINT mutation;");
+
+        try {
+            results[i] = batch[i].mutation(conn);
+        } catch (const std::exception& e) {
+            std::cerr << "Write mutation threw: " << e.what() << std::endl;
+            results[i] = SQLITE_ERROR;
+        } catch (...) {
+            std::cerr << "Write mutation threw" << std::endl;
+            results[i] = SQLITE_ERROR;
+        }
+
+        if (results[i] != SQLITE_OK) conn.execute("ROLLBACK TO mutation;");
+        conn.execute("RELEASE mutation;");
+    }
+
+    result = conn.execute("COMMIT;");
+    if (result != SQLITE_OK) {
+        std::cerr << "Failed to commit write batch: " << sqlite3_errmsg(conn.get()) << std::endl;
+        conn.execute("ROLLBACK;");
+        failAll(result);
+        return;
+    }
+
+    batches.fetch_add(1, std::memory_order_relaxed);
+    mutations.fetch_add(batch.size(), std::memory_order_relaxed);
+
+    uint64_t size = batch.size();
+    uint64_t seen = largest.load(std::memory_order_relaxed);
+    while (size > seen && !largest.compare_exchange_weak(seen, size, std::memory_order_relaxed)) {}
+
+    // Submitters are still blocked here, so callbacks may use their state.
+    // The data is durable either way, so each callback is guarded on its own:
+    // one that throws is logged and the rest (and the hook) still run.
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (results[i] == SQLITE_OK && batch[i].committed) runCallback(batch[i].committed);
+    }
+    if (batchHook) runCallback(batchHook);
+
+    for (size_t i = 0; i < batch.size(); i++) batch[i].result.set_value(results[i]);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include "connection_pool.h"
+
+// Single-writer group commit. Handlers submit mutations; one writer thread
+// drains them in batches (bounded by count and a short time window) and runs
+// each batch inside a single BEGIN IMMEDIATE ... COMMIT, so many writes share
+// one fsync. Every mutation runs under its own savepoint, so one failing
+// mutation (e.g. a duplicate VIN) is rolled back without affecting the others.
+class WriteQueue {
+public:
+    // Runs on the writer thread inside the batch transaction. Returns SQLITE_OK
+    // on success or the SQLite error code that caused it to fail.
+    using Mutation = std::function<int(const ConnectionPool::Lease& conn)>;
+
+    // Runs on the writer thread once the mutation's batch is durable, in
+    // commit order, and only if the mutation succeeded
+    using Committed = std::function<void()>;
+
+    WriteQueue(ConnectionPool& pool, size_t maxBatch = 128,
+               std::chrono::microseconds window = std::chrono::microseconds(2000));
+    ~WriteQueue();
+
+    WriteQueue(const WriteQueue&) = delete;
+    WriteQueue& operator=(const WriteQueue&) = delete;
+
+    void start();
+    void stop();
+
+    // Queue a mutation and block until its batch has committed (or failed).
+    // Returns SQLITE_OK only if the mutation succeeded and the commit was durable;
+    // by then committed (if given) has already run.
+    int submit(Mutation mutation, Committed committed = nullptr);
+
+    // Runs on the writer thread after each committed batch, once the batch's
+    // Committed callbacks are done. Set before start().
+    void onBatchCommitted(std::function<void()> hook) { batchHook = std::move(hook); }
+
+    uint64_t batchesCommitted() const { return batches.load(std::memory_order_relaxed); }
+    uint64_t mutationsApplied() const { return mutations.load(std::memory_order_relaxed); }
+    uint64_t largestBatch() const { return largest.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending {
+        Mutation mutation;
+        Committed committed;
+        std::promise<int> result;
+    };
+
+    ConnectionPool& pool;
+    size_t maxBatch;
+    std::chrono::microseconds window;
+
+    std::mutex mutex;
+    std::condition_variable hasWork;
+    std::deque<Pending> queue;
+    bool running = false;
+    bool stopping = false;
+    std::thread writer;
+    std::function<void()> batchHook;
+
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> mutations{0};
+    std::atomic<uint64_t> largest{0};
+
+    void run();
+    void commitBatch(std::vector<Pending>& batch);
+};
@@ -1,7 +1,6 @@
 const API_URL = 'http://localhost:8080/api/cars';
 let editingCarId = null;
 let currentImageDataUrl = '';
-let allCars = []; 
 
 // Utility functions for normalizing text input
 function normalizeText(text) {
@@ -21,6 +20,7 @@ function normalizeUpperCase(text) {
 
 document.addEventListener('DOMContentLoaded', function() {
     loadCars();
+    watchChanges();
 
     document.getElementById('car-form').addEventListener('submit', handleFormSubmit);
     document.getElementById('cancel-btn').addEventListener('click', resetForm);
@@ -28,10 +28,10 @@ document.addEventListener('DOMContentLoaded', function() {
     document.getElementById('image').addEventListener('change', handleImageSelected);
     
     // Filters and sorts listeners
-    document.getElementById('filter-make').addEventListener('change', applyFiltersAndSort);
-    document.getElementById('filter-model').addEventListener('change', applyFiltersAndSort);
-    document.getElementById('filter-color').addEventListener('change', applyFiltersAndSort);
-    document.getElementById('sort-by').addEventListener('change', applyFiltersAndSort);
+    document.getElementById('filter-make').addEventListener('change', refreshListing);
+    document.getElementById('filter-model').addEventListener('change', refreshListing);
+    document.getElementById('filter-color').addEventListener('change', refreshListing);
+    document.getElementById('sort-by').addEventListener('change', refreshListing);
     document.getElementById('clear-filters').addEventListener('click', clearFilters);
     
     // Modal listeners
@@ -88,26 +88,24 @@ async function loadCars() {
     hideError();
 
     try {
-        const response = await fetch(API_URL);
-        if (!response.ok) throw new Error('Failed to load cars');
-        const cars = await response.json();
-        allCars = cars; // Store all cars
-        populateFilterOptions(cars);
-        applyFiltersAndSort();
+        await Promise.all([populateFilterOptions(), applyFiltersAndSort()]);
     } catch (error) {
         showError('Error loading cars: ' + error.message);
-        allCars = [];
         displayCars([]);
     } finally {
         showLoading(false);
     }
 }
 
-function populateFilterOptions(cars) {
-    // Gets unique values and then sorts them
-    const makes = [...new Set(cars.map(car => car.make).filter(Boolean))].sort();
-    const models = [...new Set(cars.map(car => car.model).filter(Boolean))].sort();
-    const colors = [...new Set(cars.map(car => car.color).filter(Boolean))].sort();
+async function populateFilterOptions() {
+    // Distinct values come from the API's facet counts, already sorted
+    const response = await fetch(`${API_URL}/facets`);
+    if (!response.ok) throw new Error('Failed to load filter options');
+    const facets = await response.json();
+
+    const makes = facets.make.map(entry => entry.value).filter(Boolean);
+    const models = [...new Set(facets.model.map(entry => entry.value).filter(Boolean))].sort();
+    const colors = facets.color.map(entry => entry.value);
     
     // This populates the Make dropdown
     const makeSelect = document.getElementById('filter-make');
@@ -146,49 +144,62 @@ function populateFilterOptions(cars) {
     colorSelect.value = currentColor;
 }
 
-function applyFiltersAndSort() {
-    let filteredCars = [...allCars];
-    
-    // Apply filters
+// Filtering and sorting happen in the API; only matching rows are fetched
+async function applyFiltersAndSort() {
+    const params = new URLSearchParams();
     const makeFilter = document.getElementById('filter-make').value;
     const modelFilter = document.getElementById('filter-model').value;
     const colorFilter = document.getElementById('filter-color').value;
-    
-    if (makeFilter) {
-        filteredCars = filteredCars.filter(car => car.make === makeFilter);
-    }
-    if (modelFilter) {
-        filteredCars = filteredCars.filter(car => car.model === modelFilter);
-    }
-    if (colorFilter) {
-        filteredCars = filteredCars.filter(car => car.color === colorFilter);
-    }
-    
-    // Applies sorting
     const sortBy = document.getElementById('sort-by').value;
-    
-    switch(sortBy) {
-        case 'price-asc':
-            filteredCars.sort((a, b) => a.price - b.price);
-            break;
-        case 'price-desc':
-            filteredCars.sort((a, b) => b.price - a.price);
-            break;
-        case 'year-asc':
-            filteredCars.sort((a, b) => a.year - b.year);
-            break;
-        case 'year-desc':
-            filteredCars.sort((a, b) => b.year - a.year);
-            break;
-        case 'mileage-asc':
-            filteredCars.sort((a, b) => a.mileageKm - b.mileageKm);
-            break;
-        case 'mileage-desc':
-            filteredCars.sort((a, b) => b.mileageKm - a.mileageKm);
-            break;
-    }
-    
-    displayCars(filteredCars);
+
+    if (makeFilter) params.set('make', makeFilter);
+    if (modelFilter) params.set('model', modelFilter);
+    if (colorFilter) params.set('color', colorFilter);
+    if (sortBy) params.set('sort', sortBy);
+
+    const query = params.toString();
+    const response = await fetch(query ? `${API_URL}?${query}` : API_URL);
+    if (!response.ok) throw new Error('Failed to load cars');
+    displayCars(await response.json());
+}
+
+function refreshListing() {
+    applyFiltersAndSort().catch(error => showError('Error filtering cars: ' + error.message));
+}
+
+// Reloads the listing when the server pushes a change, instead of polling.
+// Bursts of events are folded into one reload; each is acknowledged so the
+// server keeps the connection open.
+function watchChanges() {
+    const socket = new WebSocket(API_URL.replace(/^http/, 'ws') + '/stream');
+    let reloadTimer = null;
+    let helloVersion = 0;
+
+    socket.onmessage = function(event) {
+        const message = JSON.parse(event.data);
+        if (message.type === 'hello') {
+            helloVersion = message.version;
+            return;
+        }
+
+        socket.send(JSON.stringify({ ack: message.version }));
+        // Already covered by the version the stream opened at
+        if (message.version <= helloVersion) return;
+
+        clearTimeout(reloadTimer);
+        reloadTimer = setTimeout(() => {
+            populateFilterOptions().catch(() => {});
+            refreshListing();
+        }, 250);
+    };
+
+    // Reconnect after a restart or after being dropped for falling behind
+    socket.onclose = function() {
+        setTimeout(() => {
+            loadCars();
+            watchChanges();
+        }, 3000);
+    };
 }
 
 function clearFilters() {
@@ -196,7 +207,7 @@ function clearFilters() {
     document.getElementById('filter-model').value = '';
     document.getElementById('filter-color').value = '';
     document.getElementById('sort-by').value = '';
-    applyFiltersAndSort();
+    refreshListing();
 }
 
 function displayCars(cars) {
@@ -218,7 +229,7 @@ function displayCars(cars) {
                 <p><strong> Price:</strong> $${Number(car.price).toLocaleString()}</p>
                 <p><strong> Mileage:</strong> ${Number(car.mileageKm).toLocaleString()} km</p>
                 ${car.color ? `<p><strong> Color:</strong> ${escapeHtml(car.color)}</p>` : ''}
-                ${car.imageDataUrl ? `<img src="${car.imageDataUrl}" alt="Car image" style="margin-top:10px; width:100%; max-height:180px; object-fit:cover; border-radius:8px; border:2px solid #eee;">` : ''}
+                ${car.imageUrl ? `<img src="${car.imageUrl}" alt="Car image" loading="lazy" style="margin-top:10px; width:100%; max-height:180px; object-fit:cover; border-radius:8px; border:2px solid #eee;">` : ''}
             </div>
 
             <div class="car-actions" onclick="event.stopPropagation()">
@@ -254,7 +265,7 @@ function showCarModal(car) {
             <span class="modal-year">${car.year}</span>
         </div>
         
-        ${car.imageDataUrl ? `<img src="${car.imageDataUrl}" alt="${escapeHtml(car.make)} ${escapeHtml(car.model)}" class="modal-image">` : '<div style="text-align:center; padding:40px; background:#f8f9fa; border-radius:8px; margin-bottom:20px; color:#999;">📷 No image available</div>'}
+        ${car.imageUrl ? `<img src="${car.imageUrl}" alt="${escapeHtml(car.make)} ${escapeHtml(car.model)}" class="modal-image">` : '<div style="text-align:center; padding:40px; background:#f8f9fa; border-radius:8px; margin-bottom:20px; color:#999;">📷 No image available</div>'}
         
         <div class="modal-details">
             <div class="detail-item">
@@ -317,10 +328,12 @@ async function handleFormSubmit(e) {
         price: parseFloat(document.getElementById('price').value),
         mileageKm: parseInt(document.getElementById('mileage').value),
         color: normalizeText(document.getElementById('color').value),     
-        vin: normalizeUpperCase(document.getElementById('vin').value),     
-        imageDataUrl: currentImageDataUrl || null
+        vin: normalizeUpperCase(document.getElementById('vin').value)
     };
 
+    // Only send an image when one was picked; leaving it out keeps the stored one on edit
+    if (currentImageDataUrl) carData.imageDataUrl = currentImageDataUrl;
+
     // Basic validation
     if (!carData.make || !carData.model) {
         showError('Make and Model are required');
@@ -384,10 +397,10 @@ async function editCar(id) {
         document.getElementById('color').value = car.color || '';
         document.getElementById('vin').value = car.vin || '';
 
-        currentImageDataUrl = car.imageDataUrl || '';
+        currentImageDataUrl = '';
         const preview = document.getElementById('image-preview');
-        if (currentImageDataUrl) {
-            preview.src = currentImageDataUrl;
+        if (car.imageUrl) {
+            preview.src = car.imageUrl;
             preview.style.display = 'block';
         } else {
             preview.src = '';
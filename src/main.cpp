@@ -2,24 +2,14 @@
 #include "Car.h"
 #include "database.h"
 #include "CarRoutes.h"
+#include "StaticAssets.h"
 #include <iostream>
-#include <fstream>
-#include <sstream>
-
-// Function tjat allows to read file contents
-std::string readFile(const std::string& filepath) {
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        return "";
-    }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
+#include <cstdlib>
+#include <chrono>
 
 int main() {
     // Start App
-    crow::SimpleApp app;
+    CarApp app;
     
     // Start database
     Database db("data/cars.db");
@@ -31,6 +21,17 @@ int main() {
     
     std::cout << "Database up and running" << std::endl;
     
+    // JSON and text responses of 1 KB and up go out gzip/deflate-compressed
+    auto& compression = app.get_middleware<CompressionMiddleware>();
+    compression.minSize = 1024;
+    compression.level = 6;
+
+    // API requests beyond what each route class is currently handling well
+    // get a 503 with Retry-After; the limits adapt to latency
+    auto& admission = app.get_middleware<AdmissionMiddleware>();
+    admission.initialLimit = 32;
+    admission.retryAfterSeconds = 1;
+
     // setting up routes
     CarRoutes::setupRoutes(app, db);
     std::cout << "API routes configured!" << std::endl;
@@ -43,29 +44,72 @@ int main() {
         response["message"] = "Car Inventory API is running";
         return crow::response(200, response);
     });
+
+    // Runtime counters for the database layer
+    CROW_ROUTE(app, "/api/stats")
+    ([&db, &app](){
+        crow::json::wvalue response;
+        response["statementCache"]["hits"] = db.statementCacheHits();
+        response["statementCache"]["misses"] = db.statementCacheMisses();
+        response["statementCache"]["evictions"] = db.statementCacheEvictions();
+        response["writeQueue"]["batches"] = db.writeQueue().batchesCommitted();
+        response["writeQueue"]["mutations"] = db.writeQueue().mutationsApplied();
+        response["writeQueue"]["largestBatch"] = db.writeQueue().largestBatch();
+        response["jsonCache"]["hits"] = db.jsonCache().hits();
+        response["jsonCache"]["misses"] = db.jsonCache().misses();
+        response["jsonCache"]["evictions"] = db.jsonCache().evictions();
+        response["jsonCache"]["entries"] = static_cast<uint64_t>(db.jsonCache().entries());
+        response["jsonCache"]["bytes"] = static_cast<uint64_t>(db.jsonCache().bytes());
+        response["changeFeed"]["subscribers"] = static_cast<uint64_t>(db.changeFeed().subscribers());
+        response["changeFeed"]["published"] = db.changeFeed().published();
+        response["changeFeed"]["dropped"] = db.changeFeed().dropped();
+        const DbExecutor& executor = db.executor();
+        response["executor"]["threads"] = static_cast<uint64_t>(executor.threads());
+        response["executor"]["queueDepth"] = static_cast<uint64_t>(executor.depth());
+        response["executor"]["capacity"] = static_cast<uint64_t>(executor.capacity());
+        response["executor"]["executed"] = executor.executed();
+        response["executor"]["rejected"] = executor.rejected();
+        response["executor"]["avgWaitMicros"] = executor.executed() ? executor.totalWaitMicros() / executor.executed() : 0;
+        response["executor"]["maxWaitMicros"] = executor.maxWaitMicros();
+        for (const auto& entry : app.get_middleware<AdmissionMiddleware>().stats()) {
+            auto& routeClass = response["admission"][entry.first];
+            routeClass["limit"] = static_cast<uint64_t>(entry.second.limit);
+            routeClass["inFlight"] = entry.second.inFlight;
+            routeClass["admitted"] = entry.second.admitted;
+            routeClass["rejected"] = entry.second.rejected;
+            routeClass["latencyMs"] = entry.second.latencyMs;
+            routeClass["baselineMs"] = entry.second.baselineMs;
+        }
+        for (const auto& entry : app.get_middleware<CompressionMiddleware>().stats()) {
+            auto& route = response["compression"][entry.first];
+            route["responses"] = entry.second.responses;
+            route["bytesIn"] = entry.second.bytesIn;
+            route["bytesOut"] = entry.second.bytesOut;
+            route["bytesSaved"] = entry.second.bytesIn - entry.second.bytesOut;
+        }
+        return crow::response(200, response);
+    });
     
-CROW_ROUTE(app, "/")([](){
-    std::string html = readFile("frontend/index.html");
-    if (html.empty()) return crow::response(404, "Frontend not found");
-    auto res = crow::response(html);
-    res.add_header("Content-Type", "text/html");
-    return res;
+    // Frontend files are read and gzipped once here. Set FRONTEND_WATCH=1 to
+    // pick up edits without a restart.
+    StaticAssets assets;
+    assets.add("/", "frontend/index.html", "text/html");
+    assets.add("/app.js", "frontend/app.js", "application/javascript");
+    assets.add("/style.css", "frontend/style.css", "text/css");
+
+    const char* watch = std::getenv("FRONTEND_WATCH");
+    if (watch && std::string(watch) == "1") assets.watch(std::chrono::seconds(1));
+
+CROW_ROUTE(app, "/")([&assets](const crow::request& req){
+    return assets.serve(req, "/");
 });
 
-CROW_ROUTE(app, "/app.js")([](){
-    std::string js = readFile("frontend/app.js");
-    if (js.empty()) return crow::response(404, "JavaScript not found");
-    auto res = crow::response(js);
-    res.add_header("Content-Type", "application/javascript");
-    return res;
+CROW_ROUTE(app, "/app.js")([&assets](const crow::request& req){
+    return assets.serve(req, "/app.js");
 });
 
-CROW_ROUTE(app, "/style.css")([](){
-    std::string css = readFile("frontend/style.css");
-    if (css.empty()) return crow::response(404, "CSS not found");
-    auto res = crow::response(css);
-    res.add_header("Content-Type", "text/css");
-    return res;
+CROW_ROUTE(app, "/style.css")([&assets](const crow::request& req){
+    return assets.serve(req, "/style.css");
 });
 
     
@@ -0,0 +1,49 @@
+#pragma once
+#include <cctype>
+#include <cstdlib>
+#include <string>
+
+// Reads an Accept-Encoding header
+class AcceptEncoding {
+public:
+    // Quality the client gives coding (e.g. "gzip"): its own entry if listed,
+    // otherwise the "*" entry, otherwise 0. q defaults to 1.
+    static double quality(const std::string& header, const std::string& coding) {
+        double wildcard = 0;
+        size_t start = 0;
+        while (start < header.size()) {
+            size_t end = header.find(',', start);
+            if (end == std::string::npos) end = header.size();
+            std::string item = header.substr(start, end - start);
+            start = end + 1;
+
+            size_t semicolon = item.find(';');
+            std::string name = item.substr(0, semicolon);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+
+            double q = 1;
+            if (semicolon != std::string::npos) {
+                size_t at = item.find("q=", semicolon);
+                if (at != std::string::npos) q = std::strtod(item.c_str() + at + 2, nullptr);
+            }
+
+            if (equalsIgnoreCase(name, coding) || (coding == "gzip" && equalsIgnoreCase(name, "x-gzip"))) return q;
+            if (name == "*") wildcard = q;
+        }
+        return wildcard;
+    }
+
+    static bool accepts(const std::string& header, const std::string& coding) {
+        return quality(header, coding) > 0;
+    }
+
+private:
+    static bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include "crow.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Admission control for the API. Requests are grouped into route classes
+// (reads, writes, exports) and each class admits at most limit of them at
+// once; the rest get an immediate 503 with Retry-After rather than queueing
+// until they time out. Latency is measured from admission to response, so it
+// includes the wait for the database executor. The limit follows a
+// gradient: while recent latency stays within tolerance of the long-run
+// baseline it grows by about sqrt(limit), and beyond that it shrinks in
+// proportion. A 503 from further in (a full executor queue) cuts it by a
+// quarter at once. Frontend files, stats and the WebSocket stream are never
+// limited.
+struct AdmissionMiddleware {
+    struct context {
+        const char* routeClass = nullptr;   // set once admitted
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct ClassStats {
+        double limit = 0;
+        uint64_t inFlight = 0;
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        double latencyMs = 0;     // recent average
+        double baselineMs = 0;    // long-run average the gradient compares against
+    };
+
+    // Configure before the server starts
+    double initialLimit = 32;
+    double minLimit = 4;
+    double maxLimit = 1024;
+    double tolerance = 2.0;     // latency up to this multiple of the baseline counts as healthy
+    double smoothing = 0.2;     // how far one sample moves the limit toward its target
+    int retryAfterSeconds = 1;
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx) {
+        const char* routeClass = classify(req);
+        if (!routeClass) return;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        RouteClass& state = classes[routeClass];
+        if (state.limit == 0) state.limit = initialLimit;
+
+        if (state.inFlight >= static_cast<uint64_t>(state.limit)) {
+            state.rejected++;
+            lock.unlock();
+
+            crow::json::wvalue error;
+            error["error"] = "Server busy, try again shortly";
+            res = crow::response(503, error);
+            res.set_header("Retry-After", std::to_string(retryAfterSeconds));
+            res.end();
+            return;
+        }
+
+        state.inFlight++;
+        state.admitted++;
+        ctx.routeClass = routeClass;
+        ctx.start = std::chrono::steady_clock::now();
+    }
+
+    void after_handle(crow::request&, crow::response& res, context& ctx) {
+        if (!ctx.routeClass) return;
+
+        double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ctx.start).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        RouteClass& state = classes[ctx.routeClass];
+        size_t inFlight = state.inFlight--;
+        ctx.routeClass = nullptr;
+
+        if (res.code == 503) {
+            state.limit = std::max(minLimit, state.limit * 0.75);
+            return;
+        }
+        adjust(state, latencyMs, inFlight);
+    }
+
+    std::map<std::string, ClassStats> stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, ClassStats> result;
+        for (const auto& entry : classes) {
+            const RouteClass& state = entry.second;
+            result[entry.first] = ClassStats{state.limit, state.inFlight, state.admitted, state.rejected,
+                                             state.shortRtt, state.longRtt};
+        }
+        return result;
+    }
+
+private:
+    struct RouteClass {
+        double limit = 0;
+        uint64_t inFlight = 0;
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        double shortRtt = 0;   // ms, fast average
+        double longRtt = 0;    // ms, slow average
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, RouteClass> classes;
+
+    // Route class of an API request, or nullptr when it isn't limited
+    static const char* classify(const crow::request& req) {
+        if (req.upgrade || req.url.compare(0, 5, "/api/") != 0 || req.url == "/api/stats") return nullptr;
+        if (req.url.compare(0, 16, "/api/cars/export") == 0) return "export";
+
+        switch (req.method) {
+            case crow::HTTPMethod::Get:
+            case crow::HTTPMethod::Head:
+                return "read";
+            case crow::HTTPMethod::Options:
+                return nullptr;
+            default:
+                return "write";
+        }
+    }
+
+    // One latency sample taken with inFlight requests running (this one included)
+    void adjust(RouteClass& state, double latencyMs, size_t inFlight) {
+        if (state.longRtt == 0) {
+            state.shortRtt = state.longRtt = latencyMs;
+            return;
+        }
+        state.shortRtt += (latencyMs - state.shortRtt) * 0.1;
+        state.longRtt += (latencyMs - state.longRtt) * 0.01;
+
+        // Sustained overload would drag the baseline up with it; let it recover
+        if (state.longRtt > state.shortRtt * 2) state.longRtt *= 0.95;
+
+        double gradient = std::clamp(tolerance * state.longRtt / state.shortRtt, 0.5, 1.0);
+
+        // Only grow a limit the traffic actually presses against
+        if (gradient == 1.0 && inFlight < state.limit / 2) return;
+
+        double target = state.limit * gradient + std::sqrt(state.limit);
+        state.limit = std::clamp(state.limit * (1 - smoothing) + target * smoothing, minLimit, maxLimit);
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "Car.h"
+#include "CarFormat.h"
+#include "car_fields.h"
+
+// Car -> CSV (RFC 4180), one line per car, with the columns selected by a
+// CarFields mask in CarFields order and named like the JSON members. Text is
+// quoted only when it holds a comma, quote or line break.
+class CarCsv {
+public:
+    static void writeHeader(uint32_t fields, std::string& out) {
+        const CarFields::Field* list = CarFields::list();
+        bool first = true;
+        for (size_t i = 0; i < CarFields::Count; i++) {
+            if (!(fields & list[i].bit)) continue;
+            if (!first) out += ',';
+            first = false;
+            out += list[i].name;
+        }
+        out += "\r\n";
+    }
+
+    static void write(const Car& car, uint32_t fields, std::string& out) {
+        bool first = true;
+        auto column = [&](uint32_t bit) {
+            if (!(fields & bit)) return false;
+            if (!first) out += ',';
+            first = false;
+            return true;
+        };
+
+        if (column(CarFields::Id)) CarFormat::appendInt(out, car.getCarId());
+        if (column(CarFields::Make)) appendText(out, car.getMake());
+        if (column(CarFields::Model)) appendText(out, car.getModel());
+        if (column(CarFields::Year)) CarFormat::appendInt(out, car.getYear());
+        if (column(CarFields::Price)) CarFormat::appendDouble(out, car.getPrice());
+        if (column(CarFields::Mileage)) CarFormat::appendInt(out, car.getMileage());
+        if (column(CarFields::Color)) appendText(out, car.getColor());
+        if (column(CarFields::Vin)) appendText(out, car.getVin());
+        if (column(CarFields::Image) && car.hasImage()) CarFormat::appendImageUrl(out, car);
+        if (column(CarFields::CreatedAt)) appendText(out, car.getCreatedAt());
+        if (column(CarFields::UpdatedAt)) appendText(out, car.getUpdatedAt());
+
+        out += "\r\n";
+    }
+
+private:
+    static void appendText(std::string& out, const std::string& value) {
+        if (value.find_first_of(",\"\r\n") == std::string::npos) {
+            out += value;
+            return;
+        }
+
+        out += '"';
+        for (char c : value) {
+            if (c == '"') out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <string>
+#include "Car.h"
+
+// Value formatting shared by the Car writers (CarJson, CarCsv), so every
+// export format prints numbers and image links the same way
+class CarFormat {
+public:
+    static void appendInt(std::string& out, int value) {
+        char buffer[16];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr - buffer);
+    }
+
+    // Shortest text that reads back as the same double. NaN and infinities
+    // have no portable spelling: nothing is appended and the result is false.
+    static bool appendDouble(std::string& out, double value) {
+        if (!std::isfinite(value)) return false;
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr - buffer);
+        return true;
+    }
+
+    // Same link as the image route expects, pinned to the content hash. Only
+    // digits, '/' and lowercase hex, so it never needs quoting or escaping.
+    static void appendImageUrl(std::string& out, const Car& car) {
+        out += "/api/cars/";
+        appendInt(out, car.getCarId());
+        out += "/image?v=";
+        out += car.getImageHash();
+    }
+};
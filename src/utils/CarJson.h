@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "Car.h"
+#include "CarFormat.h"
+#include "car_fields.h"
+
+// Car -> JSON without an intermediate crow::json::wvalue. Appends to the
+// caller's buffer (usually the response body), with the member names as
+// literals and numbers formatted by std::to_chars. Strings that need no
+// escaping, which is nearly all of them, are appended in one go.
+class CarJson {
+public:
+    // Appends car as a JSON object with the members selected by fields
+    static void write(const Car& car, uint32_t fields, std::string& out) {
+        char separator = '{';
+        auto member = [&](const char* key, size_t length) {
+            out += separator;
+            separator = ',';
+            out.append(key, length);
+        };
+
+        if (fields & CarFields::Id) { member(IdKey, sizeof(IdKey) - 1); CarFormat::appendInt(out, car.getCarId()); }
+        if (fields & CarFields::Make) { member(MakeKey, sizeof(MakeKey) - 1); appendString(out, car.getMake()); }
+        if (fields & CarFields::Model) { member(ModelKey, sizeof(ModelKey) - 1); appendString(out, car.getModel()); }
+        if (fields & CarFields::Year) { member(YearKey, sizeof(YearKey) - 1); CarFormat::appendInt(out, car.getYear()); }
+        if (fields & CarFields::Price) { member(PriceKey, sizeof(PriceKey) - 1); appendDouble(out, car.getPrice()); }
+        if (fields & CarFields::Mileage) { member(MileageKey, sizeof(MileageKey) - 1); CarFormat::appendInt(out, car.getMileage()); }
+        if (fields & CarFields::Color) { member(ColorKey, sizeof(ColorKey) - 1); appendString(out, car.getColor()); }
+        if (fields & CarFields::Vin) { member(VinKey, sizeof(VinKey) - 1); appendString(out, car.getVin()); }
+        if (fields & CarFields::Image) { member(ImageKey, sizeof(ImageKey) - 1); appendImageUrl(out, car); }
+        if (fields & CarFields::CreatedAt) { member(CreatedKey, sizeof(CreatedKey) - 1); appendString(out, car.getCreatedAt()); }
+        if (fields & CarFields::UpdatedAt) { member(UpdatedKey, sizeof(UpdatedKey) - 1); appendString(out, car.getUpdatedAt()); }
+
+        if (separator == '{') out += '{';
+        out += '}';
+    }
+
+    static std::string toString(const Car& car, uint32_t fields = CarFields::All) {
+        std::string out;
+        out.reserve(256);
+        write(car, fields, out);
+        return out;
+    }
+
+    // JSON string literal, quotes included
+    static void appendString(std::string& out, const std::string& value) {
+        out += '"';
+
+        size_t clean = 0;
+        while (clean < value.size() && !needsEscape(value[clean])) clean++;
+        out.append(value, 0, clean);
+        if (clean < value.size()) appendEscaped(out, value, clean);
+
+        out += '"';
+    }
+
+private:
+    static constexpr char IdKey[] = "\"id\":";
+    static constexpr char MakeKey[] = "\"make\":";
+    static constexpr char ModelKey[] = "\"model\":";
+    static constexpr char YearKey[] = "\"year\":";
+    static constexpr char PriceKey[] = "\"price\":";
+    static constexpr char MileageKey[] = "\"mileageKm\":";
+    static constexpr char ColorKey[] = "\"color\":";
+    static constexpr char VinKey[] = "\"vin\":";
+    static constexpr char ImageKey[] = "\"imageUrl\":";
+    static constexpr char CreatedKey[] = "\"createdAt\":";
+    static constexpr char UpdatedKey[] = "\"updatedAt\":";
+
+    static bool needsEscape(char c) {
+        return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    }
+
+    static void appendEscaped(std::string& out, const std::string& value, size_t from) {
+        static const char hexDigits[] = "0123456789abcdef";
+        for (size_t i = from; i < value.size(); i++) {
+            char c = value[i];
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        out += "\\u00";
+                        out += hexDigits[(c >> 4) & 0xF];
+                        out += hexDigits[c & 0xF];
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+    }
+
+    // JSON has no NaN/Infinity
+    static void appendDouble(std::string& out, double value) {
+        if (!CarFormat::appendDouble(out, value)) out += "null";
+    }
+
+    static void appendImageUrl(std::string& out, const Car& car) {
+        if (!car.hasImage()) {
+            out += "null";
+            return;
+        }
+        out += '"';
+        CarFormat::appendImageUrl(out, car);
+        out += '"';
+    }
+};
@@ -0,0 +1,321 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <string>
+#include "Car.h"
+#include "car_fields.h"
+
+// Single-pass parser for car request bodies. Walks the JSON once and writes
+// recognised members straight into a Car, recording which ones were present
+// as a CarFields mask (CarFields::Image stands for imageDataUrl). A member of
+// the wrong type fails the parse on the spot; unknown members are skipped
+// without being materialised. String values are decoded into their final
+// buffer in one copy, so a multi-megabyte imageDataUrl is copied out of the
+// request body exactly once.
+class CarPayload {
+public:
+    static bool parse(const std::string& body, Car& car, uint32_t& present, std::string& error) {
+        return parse(body.data(), body.data() + body.size(), car, present, error);
+    }
+
+    static bool parse(const char* begin, const char* end, Car& car, uint32_t& present, std::string& error) {
+        Reader in{begin, end, error};
+        present = 0;
+
+        in.skipSpace();
+        if (!in.consume('{')) return in.fail("Invalid JSON");
+
+        std::string key;
+        std::string text;
+        in.skipSpace();
+        if (!in.consume('}')) {
+            do {
+                in.skipSpace();
+                if (!in.readString(key)) return in.fail("Invalid JSON");
+                in.skipSpace();
+                if (!in.consume(':')) return in.fail("Invalid JSON");
+                in.skipSpace();
+
+                if (!readMember(in, key, car, present, text)) return false;
+
+                in.skipSpace();
+            } while (in.consume(','));
+
+            if (!in.consume('}')) return in.fail("Invalid JSON");
+        }
+
+        in.skipSpace();
+        if (in.p != in.end) return in.fail("Invalid JSON");
+        return true;
+    }
+
+    // Splits a bulk body into the text of its items, handed to visit in order:
+    // the elements of a JSON array, or the non-blank lines of NDJSON when the
+    // body doesn't start with '['. Items are only delimited here, not
+    // validated, so one bad car doesn't stop the others. False if the array
+    // itself is malformed.
+    template <typename Visit>
+    static bool forEachItem(const std::string& body, Visit visit, std::string& error) {
+        Reader in{body.data(), body.data() + body.size(), error};
+        in.skipSpace();
+
+        if (!in.consume('[')) {
+            const char* line = body.data();
+            const char* end = body.data() + body.size();
+            while (line < end) {
+                const char* next = std::find(line, end, '\n');
+                Reader item{line, next, error};
+                item.skipSpace();
+                if (item.p != next) visit(line, next);
+                line = next == end ? end : next + 1;
+            }
+            return true;
+        }
+
+        in.skipSpace();
+        if (in.consume(']')) {
+            in.skipSpace();
+            return in.p == in.end || in.fail("Invalid JSON");
+        }
+
+        do {
+            in.skipSpace();
+            const char* start = in.p;
+            if (!in.skipValue()) return in.fail("Invalid JSON");
+            visit(start, in.p);
+            in.skipSpace();
+        } while (in.consume(','));
+
+        if (!in.consume(']')) return in.fail("Invalid JSON");
+        in.skipSpace();
+        return in.p == in.end || in.fail("Invalid JSON");
+    }
+
+private:
+    struct Reader {
+        const char* p;
+        const char* end;
+        std::string& error;
+
+        bool fail(const std::string& message) {
+            error = message;
+            return false;
+        }
+
+        void skipSpace() {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+        }
+
+        bool consume(char c) {
+            if (p < end && *p == c) {
+                p++;
+                return true;
+            }
+            return false;
+        }
+
+        bool consumeWord(const char* word, size_t length) {
+            if (static_cast<size_t>(end - p) < length || std::string::traits_type::compare(p, word, length) != 0) return false;
+            p += length;
+            return true;
+        }
+
+        // Decodes a JSON string into out. The run up to the first escape is
+        // sized and copied in one append, which for data URLs is the whole value.
+        bool readString(std::string& out) {
+            if (!consume('"')) return false;
+
+            const char* run = p;
+            while (p < end && *p != '"' && *p != '\\') {
+                if (static_cast<unsigned char>(*p) < 0x20) return false;
+                p++;
+            }
+            out.assign(run, p - run);
+
+            while (p < end && *p != '"') {
+                if (*p != '\\') {
+                    if (static_cast<unsigned char>(*p) < 0x20) return false;
+                    run = p;
+                    while (p < end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20) p++;
+                    out.append(run, p - run);
+                    continue;
+                }
+
+                if (++p == end) return false;
+                switch (*p++) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        unsigned int code = 0;
+                        if (!readHex4(code)) return false;
+                        if (code >= 0xD800 && code <= 0xDBFF) {
+                            unsigned int low = 0;
+                            if (!consume('\\') || !consume('u') || !readHex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                            return false;
+                        }
+                        appendUtf8(out, code);
+                        break;
+                    }
+                    default: return false;
+                }
+            }
+
+            return consume('"');
+        }
+
+        bool readHex4(unsigned int& code) {
+            if (end - p < 4) return false;
+            for (int i = 0; i < 4; i++) {
+                char c = *p++;
+                code <<= 4;
+                if (c >= '0' && c <= '9') code |= c - '0';
+                else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+                else return false;
+            }
+            return true;
+        }
+
+        static void appendUtf8(std::string& out, unsigned int code) {
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            } else if (code < 0x800) {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool readNumber(double& value) {
+            // from_chars takes no leading '+', and JSON allows none either
+            if (p < end && *p == '+') return false;
+            auto result = std::from_chars(p, end, value);
+            if (result.ec != std::errc() || !std::isfinite(value)) return false;
+            p = result.ptr;
+            return true;
+        }
+
+        // Skips any value without building it; nesting is bounded to keep the
+        // recursion shallow
+        bool skipValue(int depth = 0) {
+            if (depth > 32 || p == end) return false;
+
+            if (*p == '"') {
+                p++;
+                while (p < end && *p != '"') {
+                    if (*p == '\\' && ++p == end) return false;
+                    p++;
+                }
+                return consume('"');
+            }
+            if (*p == '{' || *p == '[') {
+                char close = *p == '{' ? '}' : ']';
+                p++;
+                skipSpace();
+                if (consume(close)) return true;
+                do {
+                    skipSpace();
+                    if (close == '}') {
+                        if (p == end || *p != '"' || !skipValue(depth + 1)) return false;
+                        skipSpace();
+                        if (!consume(':')) return false;
+                        skipSpace();
+                    }
+                    if (!skipValue(depth + 1)) return false;
+                    skipSpace();
+                } while (consume(','));
+                return consume(close);
+            }
+            if (consumeWord("true", 4) || consumeWord("false", 5) || consumeWord("null", 4)) return true;
+
+            double ignored;
+            return readNumber(ignored);
+        }
+    };
+
+    enum class Kind { Text, OptionalText, Integer, Number };
+
+    struct Member {
+        const char* name;
+        uint32_t bit;
+        Kind kind;
+    };
+
+    static bool readMember(Reader& in, const std::string& key, Car& car, uint32_t& present, std::string& text) {
+        static const Member members[] = {
+            {"make", CarFields::Make, Kind::Text},
+            {"model", CarFields::Model, Kind::Text},
+            {"year", CarFields::Year, Kind::Integer},
+            {"price", CarFields::Price, Kind::Number},
+            {"mileageKm", CarFields::Mileage, Kind::Integer},
+            {"color", CarFields::Color, Kind::OptionalText},
+            {"vin", CarFields::Vin, Kind::OptionalText},
+            {"imageDataUrl", CarFields::Image, Kind::OptionalText},
+        };
+
+        const Member* member = nullptr;
+        for (const Member& candidate : members) {
+            if (key == candidate.name) {
+                member = &candidate;
+                break;
+            }
+        }
+        if (!member) return in.skipValue() || in.fail("Invalid JSON");
+
+        present |= member->bit;
+
+        if (member->kind == Kind::Text || member->kind == Kind::OptionalText) {
+            if (in.p < in.end && *in.p == '"') {
+                if (!in.readString(text)) return in.fail("Invalid JSON");
+            } else if (member->kind == Kind::OptionalText && in.consumeWord("null", 4)) {
+                text.clear();
+            } else {
+                return in.fail(key + " must be a string");
+            }
+
+            switch (member->bit) {
+                case CarFields::Make: car.setMake(text); break;
+                case CarFields::Model: car.setModel(text); break;
+                case CarFields::Color: car.setColor(text); break;
+                case CarFields::Vin: car.setVin(text); break;
+                case CarFields::Image: car.setImageDataUrl(std::move(text)); text = std::string(); break;
+            }
+            return true;
+        }
+
+        double value = 0;
+        if (in.p == in.end || !(*in.p == '-' || (*in.p >= '0' && *in.p <= '9')) || !in.readNumber(value)) {
+            return in.fail(key + " must be a number");
+        }
+
+        if (member->kind == Kind::Integer) {
+            if (value != std::floor(value) || value < INT32_MIN || value > INT32_MAX) {
+                return in.fail(key + " must be an integer");
+            }
+            if (member->bit == CarFields::Year) car.setYear(static_cast<int>(value));
+            else car.setMileage(static_cast<int>(value));
+        } else {
+            car.setPrice(value);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include "crow.h"
+#include "AcceptEncoding.h"
+#include <zlib.h>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Compresses response bodies with gzip or deflate, whichever the client
+// prefers, once they reach minSize and their Content-Type is listed in
+// contentTypes. Responses that already carry a Content-Encoding, images,
+// partial content and anything a compressed copy wouldn't shrink go out as
+// they are. ETags of compressed responses are weakened: the bytes differ, but
+// the tag still revalidates. Counters are kept per route, with numeric
+// path segments folded into <int>.
+struct CompressionMiddleware {
+    struct context {};
+
+    struct RouteStats {
+        uint64_t responses = 0;   // compressed responses
+        uint64_t bytesIn = 0;     // body bytes before compression
+        uint64_t bytesOut = 0;    // and after
+    };
+
+    // Configure before the server starts
+    size_t minSize = 1024;
+    int level = Z_DEFAULT_COMPRESSION;   // zlib level, 1 (fast) to 9 (small)
+    std::vector<std::string> contentTypes = {"application/json", "application/javascript", "text/"};
+
+    void before_handle(crow::request&, crow::response&, context&) {}
+
+    void after_handle(crow::request& req, crow::response& res, context&) {
+        if (res.body.size() < minSize || res.code == 206) return;
+        if (!res.get_header_value("Content-Encoding").empty()) return;
+
+        const std::string& contentType = res.get_header_value("Content-Type");
+        if (contentType.compare(0, 6, "image/") == 0 || !compressible(contentType)) return;
+
+        // Whatever this client gets, a cache must not hand it to one that accepts less
+        res.add_header("Vary", "Accept-Encoding");
+
+        const std::string& accept = req.get_header_value("Accept-Encoding");
+        double gzip = AcceptEncoding::quality(accept, "gzip");
+        double deflate = AcceptEncoding::quality(accept, "deflate");
+        if (gzip <= 0 && deflate <= 0) return;
+
+        bool useGzip = gzip >= deflate;
+        std::string compressed;
+        if (!compress(res.body, useGzip, compressed) || compressed.size() >= res.body.size()) return;
+
+        record(req.url, res.body.size(), compressed.size());
+
+        res.body = std::move(compressed);
+        res.set_header("Content-Encoding", useGzip ? "gzip" : "deflate");
+
+        const std::string& etag = res.get_header_value("ETag");
+        if (!etag.empty() && etag.compare(0, 2, "W/") != 0) res.set_header("ETag", "W/" + etag);
+    }
+
+    std::map<std::string, RouteStats> stats() const {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        return routes;
+    }
+
+private:
+    mutable std::mutex statsMutex;
+    std::map<std::string, RouteStats> routes;
+
+    bool compressible(const std::string& contentType) const {
+        for (const std::string& type : contentTypes) {
+            if (contentType.compare(0, type.size(), type) == 0) return true;
+        }
+        return false;
+    }
+
+    // gzip or zlib-wrapped deflate at the configured level, in one pass
+    bool compress(const std::string& input, bool gzip, std::string& output) const {
+        z_stream stream{};
+        if (deflateInit2(&stream, level, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+        output.resize(deflateBound(&stream, input.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream.avail_in = static_cast<uInt>(input.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+        stream.avail_out = static_cast<uInt>(output.size());
+
+        int result = deflate(&stream, Z_FINISH);
+        output.resize(stream.total_out);
+        deflateEnd(&stream);
+        return result == Z_STREAM_END;
+    }
+
+    void record(const std::string& url, size_t before, size_t after) {
+        std::string route;
+        size_t start = 0;
+        while (start < url.size()) {
+            size_t end = url.find('/', start + 1);
+            if (end == std::string::npos) end = url.size();
+
+            std::string segment = url.substr(start, end - start);   // with its leading '/'
+            bool numeric = segment.size() > 1;
+            for (size_t i = 1; i < segment.size() && numeric; i++) numeric = std::isdigit(static_cast<unsigned char>(segment[i]));
+            route += numeric ? "/<int>" : segment;
+            start = end;
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        RouteStats& stats = routes[route];
+        stats.responses++;
+        stats.bytesIn += before;
+        stats.bytesOut += after;
+    }
+};
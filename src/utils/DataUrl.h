@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+
+class DataUrl {
+public:
+    // Splits a base64 "data:<mime>;base64,<payload>" URL into its MIME type and
+    // decoded bytes. Returns false for anything else (plain-text data URLs,
+    // malformed base64, ...).
+    static bool decode(const std::string& url, std::string& mimeType, std::string& bytes) {
+        if (url.compare(0, 5, "data:") != 0) return false;
+
+        size_t comma = url.find(',', 5);
+        if (comma == std::string::npos) return false;
+
+        std::string header = url.substr(5, comma - 5);
+        static const std::string base64Marker = ";base64";
+        if (header.size() < base64Marker.size() ||
+            header.compare(header.size() - base64Marker.size(), base64Marker.size(), base64Marker) != 0) {
+            return false;
+        }
+
+        // Keep only the media type, dropping parameters such as ;charset=
+        mimeType = header.substr(0, header.find(';'));
+        if (mimeType.empty()) mimeType = "text/plain";
+
+        return decodeBase64(url.data() + comma + 1, url.size() - comma - 1, bytes);
+    }
+
+private:
+    static bool decodeBase64(const char* data, size_t size, std::string& out) {
+        out.clear();
+        out.reserve(size / 4 * 3);
+
+        unsigned int buffer = 0;
+        int bits = 0;
+        size_t padding = 0;
+
+        for (size_t i = 0; i < size; i++) {
+            char c = data[i];
+            int value;
+
+            if (c >= 'A' && c <= 'Z') value = c - 'A';
+            else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') value = c - '0' + 52;
+            else if (c == '+' || c == '-') value = 62;
+            else if (c == '/' || c == '_') value = 63;
+            else if (c == '=') { padding++; continue; }
+            else if (c == '\r' || c == '\n' || c == ' ') continue;
+            else return false;
+
+            // Nothing but padding may follow the first '='
+            if (padding) return false;
+
+            buffer = (buffer << 6) | static_cast<unsigned int>(value);
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                out.push_back(static_cast<char>((buffer >> bits) & 0xFF));
+            }
+        }
+
+        return padding <= 2;
+    }
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include "crow/TinySHA1.hpp"
+#include <cstdint>
+#include <string>
+
+class Sha1 {
+public:
+    // Lowercase hex SHA-1 of bytes, as used for image and asset hashes
+    static std::string hex(const std::string& bytes) {
+        sha1::SHA1 sha;
+        sha.processBytes(bytes.data(), bytes.size());
+
+        uint32_t digest[5];
+        sha.getDigest(digest);
+
+        static const char hexDigits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(40);
+        for (uint32_t word : digest) {
+            for (int shift = 28; shift >= 0; shift -= 4) hex.push_back(hexDigits[(word >> shift) & 0xF]);
+        }
+        return hex;
+    }
+};
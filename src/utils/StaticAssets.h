@@ -0,0 +1,167 @@
+#pragma once
+#include "crow.h"
+#include "crow/compression.h"
+#include "AcceptEncoding.h"
+#include "Sha1.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Frontend files held in memory. Each file is read and gzip-compressed once
+// when it is added, and served with a strong ETag (the content's SHA-1), so a
+// request costs a lookup and a body copy. Clients revalidate every time
+// (Cache-Control: no-cache), because the URLs are not versioned.
+// watch() re-reads files that change on disk, for frontend work without restarts.
+class StaticAssets {
+public:
+    StaticAssets() = default;
+    ~StaticAssets() { stopWatching(); }
+
+    StaticAssets(const StaticAssets&) = delete;
+    StaticAssets& operator=(const StaticAssets&) = delete;
+
+    // Register every file before serving or watching. False if the file can't be read.
+    bool add(const std::string& urlPath, const std::string& filePath, const std::string& contentType) {
+        Entry& entry = entries[urlPath];
+        entry.filePath = filePath;
+        entry.contentType = contentType;
+
+        std::shared_ptr<const Asset> asset = load(entry);
+        if (!asset) {
+            std::cerr << "Failed to load static asset: " << filePath << std::endl;
+            return false;
+        }
+        std::atomic_store(&entry.asset, asset);
+        return true;
+    }
+
+    // Response for a registered path: 304 on a matching If-None-Match, the
+    // gzip variant when the client accepts it, 404 if the file was missing
+    crow::response serve(const crow::request& req, const std::string& urlPath) const {
+        auto found = entries.find(urlPath);
+        std::shared_ptr<const Asset> asset = found == entries.end() ? nullptr : std::atomic_load(&found->second.asset);
+        if (!asset) return crow::response(404, "Not found");
+
+        bool gzip = !asset->gzipped.empty() && AcceptEncoding::accepts(req.get_header_value("Accept-Encoding"), "gzip");
+        const std::string& etag = gzip ? asset->gzipTag : asset->tag;
+
+        crow::response res;
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_header("Vary", "Accept-Encoding");
+
+        // Either representation's tag proves the client holds this version
+        const std::string& ifNoneMatch = req.get_header_value("If-None-Match");
+        if (!ifNoneMatch.empty() &&
+            (ifNoneMatch.find(asset->tag) != std::string::npos || ifNoneMatch.find(asset->gzipTag) != std::string::npos)) {
+            res.code = 304;
+            return res;
+        }
+
+        res.code = 200;
+        res.set_header("Content-Type", found->second.contentType);
+        if (gzip) {
+            res.set_header("Content-Encoding", "gzip");
+            res.body = asset->gzipped;
+        } else {
+            res.body = asset->body;
+        }
+        return res;
+    }
+
+    // Polls the files every interval and reloads the ones whose modification
+    // time changed
+    void watch(std::chrono::milliseconds interval) {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        if (watcher.joinable()) return;
+
+        watching = true;
+        watcher = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(watchMutex);
+            while (!watchWake.wait_for(lock, interval, [this] { return !watching; })) {
+                reloadChanged();
+            }
+        });
+    }
+
+    void stopWatching() {
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            watching = false;
+        }
+        watchWake.notify_all();
+        if (watcher.joinable()) watcher.join();
+    }
+
+private:
+    struct Asset {
+        std::string body;
+        std::string gzipped;                     // empty when compression doesn't pay
+        std::string tag;                         // quoted, as sent in ETag
+        std::string gzipTag;
+        std::filesystem::file_time_type modified;
+    };
+
+    struct Entry {
+        std::string filePath;
+        std::string contentType;
+        std::shared_ptr<const Asset> asset;      // swapped atomically by the watcher
+    };
+
+    // Fixed once the routes are set up; only the assets inside are replaced
+    std::unordered_map<std::string, Entry> entries;
+
+    std::mutex watchMutex;
+    std::condition_variable watchWake;
+    bool watching = false;
+    std::thread watcher;
+
+    static std::shared_ptr<const Asset> load(const Entry& entry) {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(entry.filePath, error);
+        if (error) return nullptr;
+
+        std::ifstream file(entry.filePath, std::ios::binary);
+        if (!file.is_open()) return nullptr;
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+
+        auto asset = std::make_shared<Asset>();
+        asset->body = buffer.str();
+        asset->modified = modified;
+
+        std::string hash = Sha1::hex(asset->body);
+        asset->tag = "\"" + hash + "\"";
+        asset->gzipTag = "\"" + hash + "-gzip\"";
+
+        asset->gzipped = crow::compression::compress_string(asset->body, crow::compression::GZIP);
+        if (asset->gzipped.size() >= asset->body.size()) asset->gzipped.clear();
+
+        return asset;
+    }
+
+    void reloadChanged() {
+        for (auto& item : entries) {
+            Entry& entry = item.second;
+            std::shared_ptr<const Asset> current = std::atomic_load(&entry.asset);
+
+            std::error_code error;
+            auto modified = std::filesystem::last_write_time(entry.filePath, error);
+            if (error || (current && modified == current->modified)) continue;
+
+            if (std::shared_ptr<const Asset> asset = load(entry)) {
+                std::atomic_store(&entry.asset, asset);
+                std::cout << "Reloaded " << entry.filePath << std::endl;
+            }
+        }
+    }
+};
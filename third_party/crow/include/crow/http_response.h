@@ -256,7 +256,11 @@ namespace crow
                 }
                 if (complete_request_handler_)
                 {
-                    complete_request_handler_();
+                    // The handler clears itself and may hold the last reference to the
+                    // connection owning this response (when end() is called outside the
+                    // route handler); a local copy keeps both alive until we're done.
+                    auto handler = complete_request_handler_;
+                    handler();
                     manual_length_header = false;
                     skip_body = false;
                 }